@@ -0,0 +1,66 @@
+import numpy as np
+
+
+MAGIC = b"EXHUBBIN"
+VERSION = 1
+
+HEADER = np.dtype([("magic", "S8"),
+                   ("version", "<u4"),
+                   ("num_arrays", "<u4"),
+                   ("nx", "<u8"),
+                   ("U", "<f8"),
+                   ("kappa", "<f8"),
+                   ("beta", "<f8"),
+                   ("nt", "<u8"),
+                   ("padding", "V8")])
+
+TABLE_ENTRY = np.dtype([("name", "S32"),
+                        ("type", "S8"),
+                        ("ndim", "<u8"),
+                        ("shape", "<u8", (4,)),
+                        ("offset", "<u8"),
+                        ("padding", "V8")])
+
+
+def load_binary(fname):
+    """
+    Open a binary file written by exact_hubbard with --binary.
+    Returns a dict of arrays and a dict of meta data.
+
+    Arrays are read-only numpy.memmap's, so no data is read until it is accessed.
+    See saveSpectrumBinary in src/io.hpp for the format.
+    """
+
+    header = np.fromfile(fname, dtype=HEADER, count=1)[0]
+    if header["magic"] != MAGIC:
+        raise ValueError(f"{fname} is not an exact_hubbard binary file")
+    if header["version"] != VERSION:
+        raise ValueError(f"Unsupported format version {header['version']} in {fname}")
+
+    table = np.fromfile(fname, dtype=TABLE_ENTRY, count=int(header["num_arrays"]),
+                        offset=HEADER.itemsize)
+    arrays = dict()
+    for entry in table:
+        dtype = np.dtype(entry["type"].decode())
+        shape = tuple(int(n) for n in entry["shape"][:int(entry["ndim"])])
+        if np.prod(shape) == 0:
+            # cannot memory-map empty arrays
+            arrays[entry["name"].decode()] = np.empty(shape, dtype=dtype)
+        else:
+            arrays[entry["name"].decode()] = np.memmap(fname, dtype=dtype, mode="r",
+                                                       offset=int(entry["offset"]),
+                                                       shape=shape)
+
+    meta = dict(nx=int(header["nx"]), U=float(header["U"]), kappa=float(header["kappa"]),
+                beta=float(header["beta"]), nt=int(header["nt"]))
+    return arrays, meta
+
+
+def eigenvector(arrays, i):
+    """
+    Return basis indices and coefficients of eigenvector i from a spectrum file
+    written with --eigenvectors.
+    """
+
+    begin, end = arrays["eigenvector_offsets"][i:i+2]
+    return arrays["eigenvector_indices"][begin:end], arrays["eigenvector_coefficients"][begin:end]
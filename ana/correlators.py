@@ -1,6 +1,8 @@
 import numpy as np
 import matplotlib.pyplot as plt
 
+from binary import load_binary
+
 
 def linestyle(i):
     linestyles = ["-", "--", "-.", ":"]
@@ -43,8 +45,13 @@ def project_to_irreps(corrs, params):
 def load_correlators(fname):
     """
     Load correlators and meta data stored in a file.
+    Binary files (.bin) are memory-mapped instead of read.
     """
 
+    if fname.endswith(".bin"):
+        arrays, meta = load_binary(fname)
+        return arrays["correlators"], dict(U=meta["U"], kappa=meta["kappa"], beta=meta["beta"])
+
     with open(fname, "r") as f:
         assert f.readline() == "#~ correlator\n"
         assert f.readline() == "#  nx  nt\n"
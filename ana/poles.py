@@ -0,0 +1,76 @@
+import numpy as np
+import matplotlib.pyplot as plt
+
+
+def load_poles(fname):
+    """
+    Load poles of correlators and meta data stored in a file.
+    Returns a dict mapping (i, j) to arrays of frequencies and weights.
+    """
+
+    with open(fname, "r") as f:
+        assert f.readline() == "#~ poles\n"
+        assert f.readline() == "#  nx\n"
+        nx = int(f.readline())
+        assert f.readline() == "#  U  kappa  beta\n"
+        U, kappa, beta = map(float, f.readline().split(" "))
+
+    data = np.loadtxt(fname, skiprows=6, ndmin=2)
+    poles = dict()
+    for i, j in np.ndindex(nx, nx):
+        mask = (data[:, 0] == i) & (data[:, 1] == j)
+        poles[i, j] = (data[mask, 2], data[mask, 3])
+
+    return poles, dict(nx=nx, U=U, kappa=kappa, beta=beta)
+
+
+def evaluate_tau(poles, tau):
+    """
+    Evaluate correlators at imaginary times tau in [0, beta].
+    Returns an array of shape (nx, nx, len(tau)).
+    """
+
+    tau = np.asarray(tau)
+    nx = max(i for i, _ in poles) + 1
+    corrs = np.empty((nx, nx, len(tau)))
+    for (i, j), (omega, weight) in poles.items():
+        corrs[i, j] = np.exp(-np.outer(tau, omega)) @ weight
+    return corrs
+
+
+def evaluate_matsubara(poles, beta, n):
+    """
+    Evaluate correlators at fermionic Matsubara frequencies (2n+1) pi / beta.
+    Computes G(i w_n) = int_0^beta dtau exp(i w_n tau) C(tau).
+    Returns an array of shape (nx, nx, len(n)).
+    """
+
+    freqs = (2*np.asarray(n) + 1) * np.pi / beta
+    nx = max(i for i, _ in poles) + 1
+    corrs = np.empty((nx, nx, len(freqs)), dtype=complex)
+    for (i, j), (omega, weight) in poles.items():
+        denominator = 1j*freqs[:, np.newaxis] - omega[np.newaxis, :]
+        corrs[i, j] = (-(np.exp(-beta*omega) + 1) / denominator) @ weight
+    return corrs
+
+
+def main():
+    poles, params = load_poles("../poles.dat")
+
+    tau = np.linspace(0, params["beta"], 1000)
+    corrs = evaluate_tau(poles, tau)
+
+    fig = plt.figure()
+    ax = fig.add_subplot(111)
+    ax.set_xlabel(r"$\kappa \tau$")
+    ax.set_ylabel(r"$C(\tau)$")
+    for i, j in np.ndindex(corrs.shape[:2]):
+        ax.plot(tau * params["kappa"], corrs[i, j], c=f"C{i}")
+    ax.set_yscale("log")
+
+    fig.tight_layout()
+    plt.show()
+
+
+if __name__ == '__main__':
+    main()
@@ -3,6 +3,8 @@ from collections import Counter
 import numpy as np
 import matplotlib.pyplot as plt
 
+from binary import load_binary
+
 
 def collect_degenerates(spectrum):
     q_to_e = dict()
@@ -17,8 +19,19 @@ def collect_degenerates(spectrum):
     return charges, energies
 
 
+def load_spectrum(fname):
+    """
+    Load a spectrum as an array of shape (n, 2) holding charges and energies.
+    """
+
+    if fname.endswith(".bin"):
+        arrays, _ = load_binary(fname)
+        return np.stack((arrays["charges"], arrays["energies"]), axis=1)
+    return np.loadtxt(fname)
+
+
 def main():
-    spectrum = np.loadtxt("spectrum.dat")
+    spectrum = load_spectrum("spectrum.dat")
 
     fig = plt.figure()
     ax = fig.add_subplot(111)
@@ -55,9 +55,9 @@ else ()
 endif ()
 
 if (${PARALLEL_BLAS})
-  set(BLAZE_CXX_FLAGS "-DBLAZE_BLAS_MODE=1;-DBLAS_IS_PARALLEL=1")
+  set(blaze_CXX_FLAGS "-DBLAZE_BLAS_MODE=1;-DBLAS_IS_PARALLEL=1")
 else ()
-  set(BLAZE_CXX_FLAGS "-DBLAZE_BLAS_MODE=1;-DBLAS_IS_PARALLEL=0")
+  set(blaze_CXX_FLAGS "-DBLAZE_BLAS_MODE=1;-DBLAS_IS_PARALLEL=0")
 endif ()
 
 # link against BLAS and LAPACK and tell blaze about it
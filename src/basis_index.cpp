@@ -0,0 +1,34 @@
+#include "basis_index.hpp"
+
+#include <stdexcept>
+
+
+namespace {
+    /// Return the smallest power of 2 that is not less than n.
+    std::size_t nextPowerOf2(std::size_t const n) noexcept
+    {
+        std::size_t res = 1;
+        while (res < n) {
+            res <<= 1;
+        }
+        return res;
+    }
+}
+
+
+BasisIndex::BasisIndex(SumState const &basis)
+        : slots_(nextPowerOf2(2 * basis.size() + 1)),
+          mask_{slots_.size() - 1},
+          size_{basis.size()}
+{
+    for (std::size_t i = 0; i < basis.size(); ++i) {
+        State const &state = basis[i].second;
+        std::size_t slot = state.hash() & mask_;
+        for (; slots_[slot].index != npos; slot = (slot + 1) & mask_) {
+            if (slots_[slot].key == state) {
+                throw std::invalid_argument("Basis contains the same state multiple times");
+            }
+        }
+        slots_[slot] = Slot{state, i};
+    }
+}
@@ -0,0 +1,78 @@
+#ifndef EXACT_HUBBARD_BASIS_INDEX_HPP
+#define EXACT_HUBBARD_BASIS_INDEX_HPP
+
+/** \file
+ * \brief Map states to their position in a basis.
+ */
+
+#include <cstddef>
+#include <limits>
+#include <vector>
+
+#include "state.hpp"
+
+
+/**
+ * Look up the index of a state in a basis in constant time.
+ *
+ * Uses an open addressing hash table with linear probing over the packed state words.
+ * The table is at most half full so probe sequences stay short.
+ */
+class BasisIndex
+{
+public:
+    /// Returned by find if a state is not in the basis.
+    constexpr static std::size_t npos = std::numeric_limits<std::size_t>::max();
+
+
+    /// Construct an empty index.
+    BasisIndex() = default;
+
+
+    /**
+     * Construct the index for a basis.
+     * \throws std::invalid_argument if the basis contains a state more than once.
+     */
+    explicit BasisIndex(SumState const &basis);
+
+
+    /// Return the index of a state in the basis or `npos` if the state is not in the basis.
+    [[nodiscard]] std::size_t find(State const &state) const noexcept
+    {
+        if (slots_.empty()) {
+            return npos;
+        }
+
+        for (std::size_t slot = state.hash() & mask_; ; slot = (slot + 1) & mask_) {
+            auto const &[key, index] = slots_[slot];
+            if (index == npos) {
+                return npos;
+            }
+            if (key == state) {
+                return index;
+            }
+        }
+    }
+
+
+    /// Return the number of indexed states.
+    [[nodiscard]] std::size_t size() const noexcept
+    {
+        return size_;
+    }
+
+
+private:
+    /// A state and its position in the basis, position is `npos` for empty slots.
+    struct Slot
+    {
+        State key;
+        std::size_t index = npos;
+    };
+
+    std::vector<Slot> slots_;
+    std::size_t mask_ = 0;
+    std::size_t size_ = 0;
+};
+
+#endif //EXACT_HUBBARD_BASIS_INDEX_HPP
@@ -0,0 +1,72 @@
+#include "block_sparse.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <utility>
+
+
+BlockSparseMatrix::BlockSparseMatrix(std::size_t const rows, std::size_t const columns,
+                                     std::vector<Block> blocks)
+        : rows_{rows}, columns_{columns}, blocks_{std::move(blocks)}
+{
+    std::sort(blocks_.begin(), blocks_.end(), [](Block const &a, Block const &b) {
+        return std::pair{a.rowOffset, a.columnOffset} < std::pair{b.rowOffset, b.columnOffset};
+    });
+
+#ifndef NDEBUG
+    for (auto const &block : blocks_) {
+        assert(block.rowOffset + block.elements.rows() <= rows_);
+        assert(block.columnOffset + block.elements.columns() <= columns_);
+    }
+#endif
+}
+
+
+std::size_t BlockSparseMatrix::rows() const noexcept
+{
+    return rows_;
+}
+
+
+std::size_t BlockSparseMatrix::columns() const noexcept
+{
+    return columns_;
+}
+
+
+std::vector<BlockSparseMatrix::Block> const &BlockSparseMatrix::blocks() const noexcept
+{
+    return blocks_;
+}
+
+
+DSparseMatrix BlockSparseMatrix::toSparse(double const threshold) const
+{
+    std::vector<std::size_t> rowOffsets{0};
+    std::vector<std::size_t> columnIndices;
+    std::vector<double> values;
+
+    // Blocks are sorted by rows first, so all blocks of a row are contiguous.
+    auto first = blocks_.begin();
+    for (std::size_t i = 0; i < rows_; ++i) {
+        while (first != blocks_.end() and first->rowOffset + first->elements.rows() <= i) {
+            ++first;
+        }
+        for (auto block = first;
+             block != blocks_.end() and block->rowOffset <= i
+             and i < block->rowOffset + block->elements.rows();
+             ++block) {
+            for (std::size_t j = 0; j < block->elements.columns(); ++j) {
+                if (double const value = block->elements(i - block->rowOffset, j);
+                        std::abs(value) > threshold) {
+                    columnIndices.push_back(block->columnOffset + j);
+                    values.push_back(value);
+                }
+            }
+        }
+        rowOffsets.push_back(columnIndices.size());
+    }
+
+    return fromCompressedRows(rows_, columns_, rowOffsets, columnIndices, values);
+}
@@ -0,0 +1,76 @@
+#ifndef EXACT_HUBBARD_BLOCK_SPARSE_HPP
+#define EXACT_HUBBARD_BLOCK_SPARSE_HPP
+
+/** \file
+ * \brief Matrices made up of dense blocks between sectors.
+ */
+
+#include <cstddef>
+#include <vector>
+
+#include "linalg.hpp"
+
+
+/**
+ * A matrix that consists of dense blocks, each coupling a pair of sectors.
+ *
+ * Rows and columns are grouped into sectors and only blocks for pairs of sectors that
+ * may have non-zero elements are stored.
+ * All other elements are zero.
+ */
+class BlockSparseMatrix
+{
+public:
+    /// Dense block of elements between a row sector and a column sector.
+    struct Block
+    {
+        /// Index of the sector of rows.
+        std::size_t rowSector;
+        /// Index of the sector of columns.
+        std::size_t columnSector;
+        /// Index of the first row of the block in the full matrix.
+        std::size_t rowOffset;
+        /// Index of the first column of the block in the full matrix.
+        std::size_t columnOffset;
+        /// Elements of the block.
+        DMatrix elements;
+    };
+
+
+    /// Construct an empty matrix.
+    BlockSparseMatrix() = default;
+
+
+    /**
+     * Construct from blocks.
+     * \param rows Number of rows of the full matrix.
+     * \param columns Number of columns of the full matrix.
+     * \param blocks Non-zero blocks, must not overlap.
+     */
+    BlockSparseMatrix(std::size_t rows, std::size_t columns, std::vector<Block> blocks);
+
+
+    /// Return the number of rows of the full matrix.
+    [[nodiscard]] std::size_t rows() const noexcept;
+
+    /// Return the number of columns of the full matrix.
+    [[nodiscard]] std::size_t columns() const noexcept;
+
+    /// Return all stored blocks ordered by row sector and column sector.
+    [[nodiscard]] std::vector<Block> const &blocks() const noexcept;
+
+
+    /**
+     * Convert to a sparse matrix.
+     * \param threshold Elements with an absolute value up to this are dropped.
+     */
+    [[nodiscard]] DSparseMatrix toSparse(double threshold = 1e-8) const;
+
+
+private:
+    std::size_t rows_ = 0;
+    std::size_t columns_ = 0;
+    std::vector<Block> blocks_;
+};
+
+#endif //EXACT_HUBBARD_BLOCK_SPARSE_HPP
@@ -6,6 +6,7 @@
  */
 
 static_assert(NSITES > 0, "There must be more than 0 sites.");
+static_assert(NSITES <= maxNumSites, "There must be at most maxNumSites sites.");
 
 
 namespace {
@@ -25,6 +26,23 @@ static_assert(sitesAreInRange(nearestNeighbours),
               "All sites in nearestNeighbours must be between 0 and NSITES");
 
 
+namespace {
+    template <std::size_t N>
+    constexpr bool hasNoSelfLinks(std::array<Link, N> const &links) noexcept
+    {
+        for (auto const &[a, b] : links) {
+            if (a == b) {
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+static_assert(hasNoSelfLinks(nearestNeighbours),
+              "nearestNeighbours must not link a site to itself.");
+
+
 namespace {
     template <std::size_t N>
     constexpr bool containsEverySite(std::array<Link, N> const &links) noexcept
@@ -47,3 +65,55 @@ namespace {
 
 static_assert(containsEverySite(nearestNeighbours),
               "nearestNeighbours must contain links for every site on the lattice.");
+
+
+namespace {
+    template <std::size_t N>
+    constexpr bool isPermutation(std::array<std::size_t, N> const &perm) noexcept
+    {
+        std::array<bool, N> seen{};
+        for (auto const x : perm) {
+            if (x >= N or seen[x]) {
+                return false;
+            }
+            seen[x] = true;
+        }
+        return true;
+    }
+
+
+    template <std::size_t N>
+    constexpr bool hasLink(std::array<Link, N> const &links, Link const link) noexcept
+    {
+        for (auto const &[a, b] : links) {
+            if ((a == link.first and b == link.second)
+                or (a == link.second and b == link.first)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+
+    template <std::size_t N, std::size_t M>
+    constexpr bool generatorsAreSymmetries(
+            std::array<std::array<std::size_t, NSITES>, M> const &generators,
+            std::array<Link, N> const &links) noexcept
+    {
+        for (auto const &generator : generators) {
+            if (not isPermutation(generator)) {
+                return false;
+            }
+            for (auto const &[a, b] : links) {
+                if (not hasLink(links, Link{generator[a], generator[b]})) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+}
+
+static_assert(generatorsAreSymmetries(latticeSymmetryGenerators, nearestNeighbours),
+              "latticeSymmetryGenerators must be permutations of sites "
+              "that map nearestNeighbours onto itself.");
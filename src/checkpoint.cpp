@@ -0,0 +1,116 @@
+#include "checkpoint.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <utility>
+
+#include "io.hpp"
+
+
+namespace {
+    constexpr char recordMagic[8] = {'E', 'X', 'H', 'U', 'B', 'C', 'K', 'P'};
+    constexpr char const *keyFileName = "key";
+    constexpr char const *recordExtension = ".ckpt";
+
+
+    template <typename T>
+    void writeArrays(std::ostream &os, std::vector<std::vector<T>> const &arrays)
+    {
+        std::uint64_t const numArrays = arrays.size();
+        os.write(reinterpret_cast<char const *>(&numArrays), sizeof numArrays);
+        for (auto const &array : arrays) {
+            std::uint64_t const size = array.size();
+            os.write(reinterpret_cast<char const *>(&size), sizeof size);
+            os.write(reinterpret_cast<char const *>(array.data()),
+                     static_cast<std::streamsize>(size * sizeof(T)));
+        }
+    }
+
+
+    template <typename T>
+    std::vector<std::vector<T>> readArrays(std::istream &is)
+    {
+        std::uint64_t numArrays = 0;
+        is.read(reinterpret_cast<char *>(&numArrays), sizeof numArrays);
+        std::vector<std::vector<T>> arrays;
+        for (std::uint64_t a = 0; a < numArrays and is; ++a) {
+            std::uint64_t size = 0;
+            is.read(reinterpret_cast<char *>(&size), sizeof size);
+            arrays.emplace_back(size);
+            is.read(reinterpret_cast<char *>(arrays.back().data()),
+                    static_cast<std::streamsize>(size * sizeof(T)));
+        }
+        return arrays;
+    }
+}
+
+
+Checkpoint::Checkpoint(fs::path directory, std::string const &key, bool const resume)
+        : directory_{std::move(directory)}
+{
+    fs::create_directories(directory_);
+    auto const keyFile = directory_ / keyFileName;
+
+    if (resume and fs::exists(keyFile)) {
+        std::string storedKey;
+        std::ifstream{keyFile} >> storedKey;
+        if (storedKey != key) {
+            throw std::runtime_error("Checkpoint in " + directory_.string()
+                                     + " was written for different parameters");
+        }
+        return;
+    }
+
+    for (auto const &entry : fs::directory_iterator{directory_}) {
+        if (entry.path().extension() == recordExtension) {
+            fs::remove(entry.path());
+        }
+    }
+    writeAtomically(keyFile, [&key](fs::path const &fname) {
+        std::ofstream{fname} << key << '\n';
+    });
+}
+
+
+std::optional<Checkpoint::Record> Checkpoint::load(std::string const &unit) const
+{
+    std::ifstream ifs{file(unit), std::ios::binary};
+    if (not ifs) {
+        return std::nullopt;
+    }
+
+    char magic[sizeof recordMagic];
+    ifs.read(magic, sizeof magic);
+    if (not ifs or not std::equal(std::begin(magic), std::end(magic), std::begin(recordMagic))) {
+        return std::nullopt;
+    }
+    Record record;
+    record.reals = readArrays<double>(ifs);
+    record.integers = readArrays<std::uint64_t>(ifs);
+    if (not ifs) {
+        return std::nullopt;
+    }
+    return record;
+}
+
+
+void Checkpoint::save(std::string const &unit, Record const &record) const
+{
+    writeAtomically(file(unit), [&record](fs::path const &fname) {
+        std::ofstream ofs{fname, std::ios::binary};
+        ofs.write(recordMagic, sizeof recordMagic);
+        writeArrays(ofs, record.reals);
+        writeArrays(ofs, record.integers);
+        if (not ofs) {
+            throw std::runtime_error("Failed to write checkpoint " + fname.string());
+        }
+    });
+}
+
+
+fs::path Checkpoint::file(std::string const &unit) const
+{
+    return directory_ / (unit + recordExtension);
+}
@@ -0,0 +1,63 @@
+#ifndef EXACT_HUBBARD_CHECKPOINT_HPP
+#define EXACT_HUBBARD_CHECKPOINT_HPP
+
+/** \file
+ * \brief Checkpoints for resuming interrupted computations.
+ */
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+
+/**
+ * Directory of results of independent units of work, e.g. sectors of a spectrum.
+ *
+ * Each unit is stored in its own file which is written atomically,
+ * so a unit is either complete or missing after a crash.
+ * The directory also holds a key that identifies the computation,
+ * results are only reused if the key matches.
+ * Units can be saved and loaded concurrently as long as they have different names.
+ */
+class Checkpoint
+{
+public:
+    /// Arrays stored for a unit of work.
+    struct Record
+    {
+        std::vector<std::vector<double>> reals;
+        std::vector<std::vector<std::uint64_t>> integers;
+    };
+
+
+    /**
+     * Open a checkpoint directory.
+     * \param directory Created if it does not exist.
+     * \param key Identifies the computation, e.g. a hash of its parameters.
+     * \param resume If `true`, keep existing units, otherwise delete them.
+     * \throws std::runtime_error if `resume` is `true` and the directory holds units
+     *         of a computation with a different key.
+     */
+    Checkpoint(fs::path directory, std::string const &key, bool resume);
+
+
+    /// Return the stored results of a unit or nothing if it has not been saved.
+    [[nodiscard]] std::optional<Record> load(std::string const &unit) const;
+
+
+    /// Store the results of a unit.
+    void save(std::string const &unit, Record const &record) const;
+
+
+private:
+    fs::path directory_;
+
+
+    [[nodiscard]] fs::path file(std::string const &unit) const;
+};
+
+#endif //EXACT_HUBBARD_CHECKPOINT_HPP
@@ -0,0 +1,196 @@
+#include "cli.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+
+namespace {
+    /// Parse a comma separated list of numbers.
+    std::vector<double> parseList(std::string const &arg)
+    {
+        std::vector<double> values;
+        std::size_t begin = 0;
+        while (true) {
+            auto const end = std::min(arg.find(',', begin), arg.size());
+            try {
+                std::size_t length;
+                values.push_back(std::stod(arg.substr(begin, end - begin), &length));
+                if (length != end - begin) {
+                    throw std::invalid_argument("");
+                }
+            }
+            catch (std::logic_error const &) {
+                throw std::invalid_argument("Invalid list of numbers: " + arg);
+            }
+            if (end == arg.size()) {
+                return values;
+            }
+            begin = end + 1;
+        }
+    }
+
+
+    /// Parse a time lattice formatted as "beta,nt".
+    TimeLattice parseTimeLattice(std::string const &arg)
+    {
+        auto const comma = arg.find(',');
+        if (comma == std::string::npos) {
+            throw std::invalid_argument("Expected BETA,NT but got " + arg);
+        }
+        try {
+            std::size_t endBeta;
+            std::size_t endNt;
+            TimeLattice const timeLattice{std::stod(arg.substr(0, comma), &endBeta),
+                                          std::stoul(arg.substr(comma + 1), &endNt)};
+            if (endBeta != comma or endNt != arg.size() - comma - 1
+                or timeLattice.beta <= 0.0 or timeLattice.nt < 2) {
+                throw std::invalid_argument("");
+            }
+            return timeLattice;
+        }
+        catch (std::logic_error const &) {
+            throw std::invalid_argument("Invalid BETA,NT: " + arg);
+        }
+    }
+}
+
+
+CommandLine parseCommandLine(int const argc, char const *const *const argv)
+{
+    CommandLine cli;
+    std::vector<double> Us;
+    std::vector<double> kappas;
+    for (int i = 1; i < argc; ++i) {
+        std::string const arg{argv[i]};
+        auto const value = [&]() -> std::string {
+            if (i + 1 == argc) {
+                throw std::invalid_argument("Missing value for " + arg);
+            }
+            return argv[++i];
+        };
+
+        if (arg == "--poles") {
+            cli.poles = true;
+        }
+        else if (arg == "--beta-nt") {
+            cli.timeLattices.push_back(parseTimeLattice(value()));
+        }
+        else if (arg == "--binary") {
+            cli.binary = true;
+        }
+        else if (arg == "--eigenvectors") {
+            cli.eigenvectors = true;
+        }
+        else if (arg == "--cache") {
+            cli.cacheDirectory = value();
+        }
+        else if (arg == "--checkpoint") {
+            cli.checkpointDirectory = value();
+        }
+        else if (arg == "--resume") {
+            cli.resume = true;
+        }
+        else if (arg == "--lattice") {
+            cli.latticeFile = value();
+        }
+        else if (arg == "--max-charge") {
+            auto const str = value();
+            try {
+                std::size_t length;
+                cli.maxCharge = std::stoul(str, &length);
+                // correlators need the sectors with charge +-1
+                if (length != str.size() or str.front() == '-' or cli.maxCharge < 1) {
+                    throw std::invalid_argument("");
+                }
+            }
+            catch (std::logic_error const &) {
+                throw std::invalid_argument("Invalid maximum charge: " + str);
+            }
+        }
+        else if (arg == "--U") {
+            auto const values = parseList(value());
+            Us.insert(Us.end(), values.begin(), values.end());
+        }
+        else if (arg == "--kappa") {
+            auto const values = parseList(value());
+            kappas.insert(kappas.end(), values.begin(), values.end());
+        }
+        else if (arg == "-h" or arg == "--help") {
+            cli.help = true;
+        }
+        else {
+            throw std::invalid_argument("Unknown argument: " + arg);
+        }
+    }
+
+    if (cli.eigenvectors and not cli.binary) {
+        throw std::invalid_argument("--eigenvectors requires --binary");
+    }
+    if (cli.resume and cli.checkpointDirectory.empty()) {
+        throw std::invalid_argument("--resume requires --checkpoint");
+    }
+    if (cli.timeLattices.empty()) {
+        cli.timeLattices.push_back(TimeLattice{beta, NT});
+    }
+    if (Us.empty()) {
+        Us.push_back(U);
+    }
+    if (kappas.empty()) {
+        kappas.push_back(kappa);
+    }
+    for (auto const u : Us) {
+        for (auto const k : kappas) {
+            auto const duplicate = std::find_if(
+                    cli.parameters.begin(), cli.parameters.end(),
+                    [u, k](HubbardParameters const &p) { return p.U == u and p.kappa == k; });
+            if (duplicate != cli.parameters.end()) {
+                throw std::invalid_argument("U = " + std::to_string(u) + ", kappa = "
+                                            + std::to_string(k) + " is given more than once");
+            }
+            cli.parameters.push_back(HubbardParameters{u, k});
+        }
+    }
+    if (not cli.checkpointDirectory.empty() and cli.parameters.size() > 1) {
+        throw std::invalid_argument("--checkpoint cannot be used with several values of U "
+                                    "or kappa, use --cache instead");
+    }
+    return cli;
+}
+
+
+std::string usage(std::string const &programName)
+{
+    return "Usage: " + programName + " [options]\n"
+           "Options:\n"
+           "  --beta-nt BETA,NT  Compute correlators at inverse temperature BETA with NT\n"
+           "                     time slices. Can be given multiple times to compute\n"
+           "                     several sets of correlators from one spectrum.\n"
+           "                     Defaults to beta and NT from config.hpp.\n"
+           "  --U U1,U2,...      Compute spectra and correlators for each on-site\n"
+           "                     interaction strength, defaults to U from config.hpp.\n"
+           "  --kappa K1,K2,...  Compute spectra and correlators for each hopping\n"
+           "                     parameter, defaults to kappa from config.hpp.\n"
+           "                     All combinations of U and kappa are computed and the\n"
+           "                     Hamiltonian is assembled only once for all of them.\n"
+           "  --lattice FILE     Read the lattice geometry from FILE instead of using\n"
+           "                     nearestNeighbours from config.hpp.\n"
+           "  --max-charge Q     Only include sectors with charge between -Q and Q in the\n"
+           "                     basis. Use this for lattices whose full fockspace is too\n"
+           "                     big. Q must be at least 1 because correlators need the\n"
+           "                     sectors with charge +-1. Correlators are accurate if\n"
+           "                     sectors with |charge| >= Q are suppressed at the given\n"
+           "                     temperatures.\n"
+           "  --poles            Save poles of the correlators to poles.dat instead of\n"
+           "                     evaluating them on the time grid.\n"
+           "  --binary           Write spectra and correlators to memory-mappable binary\n"
+           "                     files with extension .bin instead of text files.\n"
+           "  --eigenvectors     Include basis and eigenvectors in binary spectrum files.\n"
+           "  --cache DIR        Load spectra from DIR if they have been computed before\n"
+           "                     and store newly computed spectra there.\n"
+           "  --checkpoint DIR   Save each sector of the spectrum and each pair of sites\n"
+           "                     of the correlators to DIR once it is computed.\n"
+           "  --resume           Continue from the checkpoints in the directory given by\n"
+           "                     --checkpoint instead of starting over.\n"
+           "  -h, --help         Show this message.\n";
+}
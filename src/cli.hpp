@@ -0,0 +1,52 @@
+#ifndef EXACT_HUBBARD_CLI_HPP
+#define EXACT_HUBBARD_CLI_HPP
+
+/** \file
+ * \brief Command line interface.
+ */
+
+#include <string>
+#include <vector>
+
+#include "correlators.hpp"
+
+
+/// Options given on the command line.
+struct CommandLine
+{
+    /// Save the Lehmann representation of correlators instead of values on the time grid.
+    bool poles = false;
+    /// Compute correlators for each of these, defaults to beta and NT from config.hpp.
+    std::vector<TimeLattice> timeLattices;
+    /// Compute spectra for each of these, defaults to U and kappa from config.hpp.
+    std::vector<HubbardParameters> parameters;
+    /// Write spectra and correlators in the binary format instead of text.
+    bool binary = false;
+    /// Include eigenvectors in binary spectrum files.
+    bool eigenvectors = false;
+    /// Directory of the spectrum cache, caching is disabled if empty.
+    std::string cacheDirectory;
+    /// Directory for checkpoints, checkpointing is disabled if empty.
+    std::string checkpointDirectory;
+    /// Resume from checkpoints in checkpointDirectory.
+    bool resume = false;
+    /// File to read the lattice from, use the lattice from config.hpp if empty.
+    std::string latticeFile;
+    /// Only include sectors with at most this magnitude of charge in the basis, at least 1.
+    std::size_t maxCharge = maxNumSites;
+    /// Print usage information and exit.
+    bool help = false;
+};
+
+
+/**
+ * Parse command line arguments.
+ * \throws std::invalid_argument if an argument is not recognised.
+ */
+CommandLine parseCommandLine(int argc, char const *const *argv);
+
+
+/// Return a description of all command line options.
+std::string usage(std::string const &programName);
+
+#endif //EXACT_HUBBARD_CLI_HPP
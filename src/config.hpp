@@ -5,6 +5,7 @@
  * \brief Configure the program.
  *
  * Specify parameters and lattice geometry in this file and compile.
+ * The lattice geometry can also be read from a file at runtime, see Lattice::fromFile.
  */
 
 
@@ -92,4 +93,50 @@ constexpr std::size_t computeNumSites()
 constexpr static std::size_t NSITES = computeNumSites();
 
 
+/**
+ * Maximum number of lattice sites of lattices read at runtime, see Lattice.
+ *
+ * States are stored in a fixed number of 64-bit words derived from this,
+ * so all kernels that operate on states have sizes known at compile time.
+ * Up to 32 sites fit into a single word.
+ */
+constexpr std::size_t maxNumSites = 32;
+
+
+/**
+ * Compute only low-lying eigenstates of each sector with the Lanczos algorithm
+ * instead of diagonalising the Hamiltonian fully.
+ */
+constexpr bool useLanczos = false;
+
+/**
+ * The Lanczos algorithm keeps all eigenstates of a sector with a Boltzmann weight
+ * exp(-beta (E - E_0)) above this cutoff where E_0 is the lowest energy in the sector.
+ * Correlators at tau are then accurate to about cutoff^(min(tau, beta-tau) / beta),
+ * see LanczosSettings::boltzmannCutoff.
+ */
+constexpr double lanczosBoltzmannCutoff = 1e-8;
+
+
+/// Use lattice symmetries to block diagonalise the Hamiltonian.
+constexpr bool useLatticeSymmetry = true;
+
+/*
+ * Generators of the lattice symmetry group.
+ * Each generator is a permutation of sites, site x is mapped to generator[x].
+ * Every generator must map nearestNeighbours onto itself.
+ *
+ * If no generators are specified, all automorphisms of nearestNeighbours are used.
+ * Specify generators of a subgroup if the automorphism group is too large.
+ */
+
+[[maybe_unused]] constexpr static std::array<std::array<std::size_t, NSITES>, 0>
+        latticeSymmetryGenerators{};
+
+// // Pentagon, rotation and reflection
+// [[maybe_unused]] constexpr static std::array<std::array<std::size_t, NSITES>, 2>
+//         latticeSymmetryGenerators{{{1, 2, 3, 4, 0},
+//                                    {0, 4, 3, 2, 1}}};
+
+
 #endif //EXACT_HUBBARD_CONFIG_HPP
@@ -0,0 +1,262 @@
+#ifndef EXACT_HUBBARD_CONFIG_TABLES_HPP
+#define EXACT_HUBBARD_CONFIG_TABLES_HPP
+
+/** \file
+ * \brief Sector and basis tables for the lattice in config.hpp computed at compile time.
+ *
+ * Only available if EXACT_HUBBARD_CONSTEXPR_TABLES is defined,
+ * see the CMake option of the same name.
+ * fockspaceBasis, fockspaceSector, and HubbardHamiltonian copy from these tables instead of
+ * enumerating states and links as long as lattice() is the lattice from config.hpp.
+ * Inconsistent tables are reported by `static_assert`.
+ */
+
+#ifdef EXACT_HUBBARD_CONSTEXPR_TABLES
+
+#include <array>
+#include <cstdint>
+#include <limits>
+
+#include "config.hpp"
+#include "hamiltonian.hpp"
+#include "lattice.hpp"
+#include "state.hpp"
+
+
+static_assert(State::bitsPerSite*NSITES <= State::bitsPerWord*State::numWords,
+              "States of the lattice in config.hpp do not fit into State::Words.");
+
+/// `true` if the number of states in the fockspace can be stored in a std::size_t.
+constexpr static bool configFockspaceSizeFits
+        = State::bitsPerSite*NSITES
+          < static_cast<std::size_t>(std::numeric_limits<std::size_t>::digits);
+
+static_assert(configFockspaceSizeFits,
+              "The fockspace of the lattice in config.hpp is too large for compile time tables, "
+              "disable EXACT_HUBBARD_CONSTEXPR_TABLES.");
+
+
+/// Number of sectors (particles, holes) of the lattice in config.hpp.
+constexpr static std::size_t configNumSectors = (NSITES + 1) * (NSITES + 1);
+
+
+/// Return the position of a sector in the tables, sectors are ordered like in fockspaceBasis.
+constexpr std::size_t configSectorIndex(std::size_t const numParticles,
+                                        std::size_t const numHoles) noexcept
+{
+    return numParticles * (NSITES + 1) + numHoles;
+}
+
+
+/// Compute the number of states in every sector.
+constexpr std::array<std::size_t, configNumSectors> computeConfigSectorSizes() noexcept
+{
+    std::array<std::size_t, configNumSectors> sizes{};
+    for (std::size_t numParticles = 0; numParticles <= NSITES; ++numParticles) {
+        for (std::size_t numHoles = 0; numHoles <= NSITES; ++numHoles) {
+            sizes[configSectorIndex(numParticles, numHoles)]
+                    = binomial(NSITES, numParticles) * binomial(NSITES, numHoles);
+        }
+    }
+    return sizes;
+}
+
+
+/// Number of states in every sector.
+constexpr static auto configSectorSizes = computeConfigSectorSizes();
+
+
+/// Compute the index of the first state of every sector in fockspaceBasis plus the total size.
+constexpr std::array<std::size_t, configNumSectors + 1> computeConfigSectorOffsets() noexcept
+{
+    std::array<std::size_t, configNumSectors + 1> offsets{};
+    for (std::size_t s = 0; s < configNumSectors; ++s) {
+        offsets[s + 1] = offsets[s] + configSectorSizes[s];
+    }
+    return offsets;
+}
+
+
+/// Index of the first state of every sector in fockspaceBasis, the last element is the total size.
+constexpr static auto configSectorOffsets = computeConfigSectorOffsets();
+
+/// Number of states in the fockspace of the lattice in config.hpp.
+constexpr static std::size_t configBasisSize = configSectorOffsets[configNumSectors];
+
+
+/// Return `true` if the sector sizes agree with binomial coefficients from Pascal's triangle.
+constexpr bool configSectorSizesMatchPascal() noexcept
+{
+    // row NSITES of Pascal's triangle, independently of binomial()
+    std::array<std::size_t, NSITES + 1> row{};
+    row[0] = 1;
+    for (std::size_t n = 1; n <= NSITES; ++n) {
+        for (std::size_t k = n; k > 0; --k) {
+            row[k] += row[k - 1];
+        }
+    }
+
+    for (std::size_t numParticles = 0; numParticles <= NSITES; ++numParticles) {
+        for (std::size_t numHoles = 0; numHoles <= NSITES; ++numHoles) {
+            if (configSectorSizes[configSectorIndex(numParticles, numHoles)]
+                != row[numParticles] * row[numHoles]) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static_assert(configSectorSizesMatchPascal(),
+              "Sector sizes must be products of binomial coefficients.");
+
+
+/// Store the basis in configBasis if the lattice has at most this many sites.
+constexpr static std::size_t maxConfigBasisSites = 8;
+
+/// `true` if configBasis holds the basis.
+constexpr static bool haveConfigBasis = NSITES <= maxConfigBasisSites;
+
+
+/// Return the state with particles (or holes if `holes` is `true`) on the sites in `mask`.
+constexpr State occupationOf(std::uint64_t const mask, bool const holes) noexcept
+{
+    State state;
+    for (std::size_t site = 0; site < NSITES; ++site) {
+        if ((mask >> site) & 1) {
+            if (holes) {
+                state.addHoleOn(site);
+            }
+            else {
+                state.addParticleOn(site);
+            }
+        }
+    }
+    return state;
+}
+
+
+/// Compute the words of all states in the same order as fockspaceBasis.
+constexpr std::array<State::Words, haveConfigBasis ? configBasisSize : 0>
+computeConfigBasis() noexcept
+{
+    std::array<State::Words, haveConfigBasis ? configBasisSize : 0> basis{};
+    if constexpr (haveConfigBasis) {
+        // Combinations of `count` sites go from the lowest to the highest sites.
+        auto const first = [](std::size_t const count) {
+            return count == 0 ? std::uint64_t{0} : ~std::uint64_t{0} >> (64 - count);
+        };
+        auto const last = [&first](std::size_t const count) {
+            return first(count) << (NSITES - count);
+        };
+
+        std::size_t i = 0;
+        for (std::size_t numParticles = 0; numParticles <= NSITES; ++numParticles) {
+            for (std::size_t numHoles = 0; numHoles <= NSITES; ++numHoles) {
+                for (auto particles = first(numParticles); ;
+                     particles = nextCombination(particles)) {
+                    State const particleState = occupationOf(particles, false);
+                    for (auto holes = first(numHoles); ; holes = nextCombination(holes)) {
+                        State const holeState = occupationOf(holes, true);
+                        for (std::size_t w = 0; w < State::numWords; ++w) {
+                            basis[i][w] = particleState.words()[w] | holeState.words()[w];
+                        }
+                        ++i;
+                        if (holes == last(numHoles)) {
+                            break;
+                        }
+                    }
+                    if (particles == last(numParticles)) {
+                        break;
+                    }
+                }
+            }
+        }
+    }
+    return basis;
+}
+
+
+/// Words of all states of the fockspace in the order of fockspaceBasis if haveConfigBasis.
+constexpr static auto configBasis = computeConfigBasis();
+
+
+static_assert(State::bitsPerSite*maxConfigBasisSites <= State::bitsPerWord,
+              "configBasis only needs the first word of each state.");
+
+
+/**
+ * Return `true` if every state in configBasis has the numbers of particles and holes
+ * of its sector in configSectorOffsets and the states of each sector are distinct.
+ */
+constexpr bool configBasisMatchesSectors() noexcept
+{
+    for (std::size_t numParticles = 0; numParticles <= NSITES; ++numParticles) {
+        for (std::size_t numHoles = 0; numHoles <= NSITES; ++numHoles) {
+            auto const sector = configSectorIndex(numParticles, numHoles);
+            for (std::size_t i = configSectorOffsets[sector];
+                 i < configSectorOffsets[sector + 1]; ++i) {
+                // Selecting every other bit keeps the order of masks of sites.
+                auto const particles = configBasis[i][0] & State::particleMask;
+                auto const holes = configBasis[i][0] & State::holeMask;
+                if (popcount(particles) != static_cast<int>(numParticles)
+                    or popcount(holes) != static_cast<int>(numHoles)) {
+                    return false;
+                }
+
+                // States are ordered by particles, then holes, so strictly increasing
+                // states are distinct.
+                if (i > configSectorOffsets[sector]) {
+                    auto const previousParticles = configBasis[i - 1][0] & State::particleMask;
+                    auto const previousHoles = configBasis[i - 1][0] & State::holeMask;
+                    if (previousParticles > particles
+                        or (previousParticles == particles and previousHoles >= holes)) {
+                        return false;
+                    }
+                }
+            }
+        }
+    }
+    return true;
+}
+
+static_assert(not haveConfigBasis or configBasisMatchesSectors(),
+              "configBasis must hold the distinct states of each sector in order.");
+
+
+/// Compute the masks of all hops in the order used by HubbardHamiltonian.
+constexpr std::array<HopMasks, 2*nearestNeighbours.size()> computeConfigHopMasks() noexcept
+{
+    std::array<HopMasks, 2*nearestNeighbours.size()> masks{};
+    for (std::size_t offset = 0; offset < 2; ++offset) {
+        for (std::size_t l = 0; l < nearestNeighbours.size(); ++l) {
+            auto const [a, b] = nearestNeighbours[l];
+            masks[offset * nearestNeighbours.size() + l]
+                    = hopMasks(2 * (a < b ? a : b) + offset, 2 * (a < b ? b : a) + offset);
+        }
+    }
+    return masks;
+}
+
+
+/// Masks of particle hops along all links of nearestNeighbours followed by hole hops.
+constexpr static auto configHopMasks = computeConfigHopMasks();
+
+
+/// Return `true` if `lat` is the lattice of config.hpp with all hopping weights equal to 1.
+inline bool isConfigLattice(Lattice const &lat) noexcept
+{
+    if (lat.numSites() != NSITES or lat.links().size() != nearestNeighbours.size()) {
+        return false;
+    }
+    for (std::size_t l = 0; l < nearestNeighbours.size(); ++l) {
+        if (lat.links()[l] != nearestNeighbours[l] or lat.hoppings()[l] != 1.0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+#endif  // EXACT_HUBBARD_CONSTEXPR_TABLES
+
+#endif //EXACT_HUBBARD_CONFIG_TABLES_HPP
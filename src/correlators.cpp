@@ -1,52 +1,315 @@
 #include "correlators.hpp"
 
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <string>
+#include <utility>
+
 #include "operator.hpp"
+#include "parallel.hpp"
+
+
+namespace {
+    /// Elements with an absolute value up to this are treated as zero.
+    constexpr double elementThreshold = 1e-8;
+
+
+    /**
+     * Terms of the spectral sum of a correlator
+     *   C(tau) = 1/Z sum_k exp(-beta energies_k) products_k exp(-tau frequencies_k)
+     * which do not depend on the temperature.
+     */
+    struct Residues
+    {
+        std::vector<double> energies;
+        std::vector<double> frequencies;
+        std::vector<double> products;
+
+
+        [[nodiscard]] std::size_t size() const noexcept
+        {
+            return energies.size();
+        }
+
+
+        /// Return exp(-beta E_alpha) A_i^{alpha gamma} A_j^{alpha gamma} for term k.
+        [[nodiscard]] double weight(std::size_t const k, double const inverseTemperature) const
+        {
+            return std::exp(-inverseTemperature * energies[k]) * products[k];
+        }
+    };
+
+
+    /**
+     * Collect the energies E_alpha, frequencies E_gamma - E_alpha, and products
+     * A_i^{alpha gamma} A_j^{alpha gamma} of all non-zero elements of Ai and Aj.
+     * Energies are shifted by `groundEnergy` so all Boltzmann factors are at most 1.
+     */
+    Residues collectResidues(BlockSparseMatrix const &Ai, BlockSparseMatrix const &Aj,
+                             Spectrum const &spectrum, double const groundEnergy)
+    {
+        Residues residues;
+
+        // Blocks are sorted by position, so matching blocks can be found by merging.
+        auto blockj = Aj.blocks().begin();
+        for (auto const &blocki : Ai.blocks()) {
+            auto const position = [](BlockSparseMatrix::Block const &block) {
+                return std::pair{block.rowOffset, block.columnOffset};
+            };
+            while (blockj != Aj.blocks().end() and position(*blockj) < position(blocki)) {
+                ++blockj;
+            }
+            if (blockj == Aj.blocks().end()) {
+                break;
+            }
+            if (position(*blockj) != position(blocki)) {
+                continue;
+            }
+
+            for (std::size_t a = 0; a < blocki.elements.rows(); ++a) {
+                double const energyAlpha = spectrum.energies[blocki.rowOffset + a] - groundEnergy;
+                for (std::size_t g = 0; g < blocki.elements.columns(); ++g) {
+                    double const elemi = blocki.elements(a, g);
+                    double const elemj = blockj->elements(a, g);
+                    if (std::abs(elemi) <= elementThreshold or std::abs(elemj) <= elementThreshold) {
+                        continue;
+                    }
+                    double const energyGamma = spectrum.energies[blocki.columnOffset + g]
+                                               - groundEnergy;
+                    residues.energies.push_back(energyAlpha);
+                    residues.frequencies.push_back(energyGamma - energyAlpha);
+                    residues.products.push_back(elemi * elemj);
+                }
+            }
+        }
+
+        return residues;
+    }
+
+
+    /// Return the ground state energy or 0 if the spectrum is empty.
+    double groundEnergyOf(Spectrum const &spectrum)
+    {
+        return spectrum.size() == 0 ? 0.0 : min(spectrum.energies);
+    }
+
+
+    /**
+     * Call `f(i, j, residues)` for all pairs of sites for which `skip(i, j)` is false
+     * in parallel.
+     * Residues are unnormalised and shifted by groundEnergyOf(spectrum).
+     */
+    template <typename Skip, typename F>
+    void forEachCorrelator(Spectrum const &spectrum, Skip const &skip, F const &f)
+    {
+        double const groundEnergy = groundEnergyOf(spectrum);
+        std::size_t const numSites = lattice().numSites();
+
+        std::vector<std::pair<std::size_t, std::size_t>> pairs;
+        for (std::size_t i = 0; i < numSites; ++i) {
+            for (std::size_t j = 0; j < numSites; ++j) {
+                if (not skip(i, j)) {
+                    pairs.emplace_back(i, j);
+                }
+            }
+        }
+        if (pairs.empty()) {
+            return;
+        }
+
+        auto const annihilatorElements = particleAnnihilatorEigenspaceMatrices(spectrum);
+
+        parallelFor(pairs.size(), [&](std::size_t const begin, std::size_t const end,
+                                      std::size_t) {
+            for (std::size_t p = begin; p < end; ++p) {
+                auto const [i, j] = pairs[p];
+                f(i, j, collectResidues(annihilatorElements[i], annihilatorElements[j],
+                                        spectrum, groundEnergy));
+            }
+        });
+    }
+
+
+    /// Return the name of the checkpoint unit of correlator i, j.
+    std::string correlatorUnit(std::size_t const i, std::size_t const j)
+    {
+        return "correlator" + std::to_string(i) + "_" + std::to_string(j);
+    }
+}
 
 
-double computeCorrelatorNormalisation(Spectrum const &spectrum)
+double computeCorrelatorNormalisation(Spectrum const &spectrum, double const inverseTemperature,
+                                      double const groundEnergy)
 {
     double normalisation = 0.0;
     for (std::size_t i = 0; i < spectrum.size(); ++i) {
-        normalisation += std::exp(-beta * spectrum.energies[i]);
+        normalisation += std::exp(-inverseTemperature * (spectrum.energies[i] - groundEnergy));
     }
     return normalisation;
 }
 
 
-Correlators computeCorrelators(Spectrum const &spectrum)
+/*
+ * Inserting eigenstates into the trace gives
+ *   C_ij(tau) = 1/Z sum_{alpha,gamma} exp((tau-beta) E_alpha - tau E_gamma)
+ *                                      A_i^{alpha gamma} A_j^{alpha gamma}
+ * Each term depends on tau only through exp(-tau (E_gamma - E_alpha)).
+ * On the grid tau_t = t dtau, this is the t-th power of exp(-dtau (E_gamma - E_alpha)),
+ * so all time slices are computed by repeated componentwise multiplication.
+ */
+std::vector<Correlators> computeCorrelators(Spectrum const &spectrum,
+                                            std::vector<TimeLattice> const &timeLattices,
+                                            Checkpoint const *const checkpoint)
 {
-    double const normalisation = computeCorrelatorNormalisation(spectrum);
+    std::vector<Correlators> corrs;
+    std::vector<double> normalisations;
+    for (auto const &timeLattice : timeLattices) {
+        corrs.emplace_back(timeLattice, spectrum.parameters);
+        normalisations.push_back(computeCorrelatorNormalisation(spectrum, timeLattice.beta,
+                                                                groundEnergyOf(spectrum)));
+    }
+
+    // Load finished correlators.
+    auto const skip = [&](std::size_t const i, std::size_t const j) {
+        if (not checkpoint) {
+            return false;
+        }
+        auto const record = checkpoint->load(correlatorUnit(i, j));
+        if (not record or record->reals.size() != timeLattices.size()) {
+            return false;
+        }
+        for (std::size_t l = 0; l < timeLattices.size(); ++l) {
+            if (record->reals[l].size() != timeLattices[l].nt) {
+                return false;
+            }
+        }
+        for (std::size_t l = 0; l < timeLattices.size(); ++l) {
+            for (std::size_t t = 0; t < timeLattices[l].nt; ++t) {
+                corrs[l](i, j, t) = record->reals[l][t];
+            }
+        }
+        return true;
+    };
+
+    forEachCorrelator(spectrum, skip, [&](std::size_t const i, std::size_t const j,
+                                          Residues const &residues) {
+        DVector terms(residues.size());
+        DVector factors(residues.size());
+        for (std::size_t l = 0; l < timeLattices.size(); ++l) {
+            auto const [inverseTemperature, nt] = timeLattices[l];
+            double const deltaTau = inverseTemperature / static_cast<double>(nt - 1);
+            for (std::size_t k = 0; k < residues.size(); ++k) {
+                terms[k] = residues.weight(k, inverseTemperature);
+                factors[k] = std::exp(-deltaTau * residues.frequencies[k]);
+            }
+
+            for (std::size_t t = 0; t < nt; ++t) {
+                corrs[l](i, j, t) = sum(terms) / normalisations[l];
+                terms *= factors;
+            }
+        }
+
+        if (checkpoint) {
+            Checkpoint::Record record;
+            for (std::size_t l = 0; l < timeLattices.size(); ++l) {
+                auto const begin = corrs[l].data.begin()
+                                   + static_cast<std::ptrdiff_t>(corrs[l].totalIndex(i, j, 0));
+                record.reals.emplace_back(begin, begin + static_cast<std::ptrdiff_t>(
+                        timeLattices[l].nt));
+            }
+            checkpoint->save(correlatorUnit(i, j), record);
+        }
+    });
+
+    return corrs;
+}
+
 
-    std::vector<DSparseMatrix> annihilatorElements;
-    annihilatorElements.reserve(NSITES);
-    for (std::size_t i = 0; i < NSITES; ++i) {
-        DSparseMatrix const elementsFockspace = toMatrix(ParticleAnnihilator{i},
-                                                         spectrum.basis);
-        annihilatorElements.emplace_back(toEigenspaceMatrix(elementsFockspace, spectrum));
+std::vector<CorrelatorPoles> computeCorrelatorPoles(Spectrum const &spectrum,
+                                                    std::vector<double> const &betas,
+                                                    double const tolerance)
+{
+    std::vector<CorrelatorPoles> poles;
+    std::vector<double> normalisations;
+    for (auto const inverseTemperature : betas) {
+        poles.emplace_back(inverseTemperature, spectrum.parameters);
+        normalisations.push_back(computeCorrelatorNormalisation(spectrum, inverseTemperature,
+                                                                groundEnergyOf(spectrum)));
     }
 
-    Correlators corrs;
-    for (std::size_t i = 0; i < NSITES; ++i) {
-        auto const &Ai = annihilatorElements[i];
-        for (std::size_t j = 0; j < NSITES; ++j) {
-            auto const &Aj = annihilatorElements[j];
+    forEachCorrelator(spectrum, [](std::size_t, std::size_t) { return false; },
+                      [&](std::size_t const i, std::size_t const j, Residues const &residues) {
+        // Group terms with (almost) equal frequencies, groups are the same for all betas.
+        std::vector<std::size_t> order(residues.size());
+        std::iota(order.begin(), order.end(), std::size_t{0});
+        std::sort(order.begin(), order.end(), [&residues](std::size_t const a, std::size_t const b) {
+            return residues.frequencies[a] < residues.frequencies[b];
+        });
+        std::vector<std::size_t> groupBegins;
+        for (std::size_t k = 0; k < order.size();) {
+            groupBegins.push_back(k);
+            double const first = residues.frequencies[order[k]];
+            double const maxFrequency = first + tolerance * std::max(1.0, std::abs(first));
+            for (; k < order.size() and residues.frequencies[order[k]] <= maxFrequency; ++k) { }
+        }
+        groupBegins.push_back(order.size());
+
+        for (std::size_t b = 0; b < betas.size(); ++b) {
+            double const inverseTemperature = betas[b];
+            // Largest magnitude of the contribution of a pole for tau in [0, beta].
+            auto const magnitude = [inverseTemperature](Pole const &pole) {
+                return std::abs(pole.weight)
+                       * std::max(1.0, std::exp(-inverseTemperature * pole.frequency));
+            };
 
-            for (std::size_t t = 0; t < NT; ++t) {
-                double const tau = beta / static_cast<double>(NT - 1) * static_cast<double>(t);
-                /*
-                 * This implements
-                 *   Tr(B * A_i * C * A_j^T)
-                 *   B = exp((tau-beta) * E)
-                 *   C = exp(-tau * E)
-                 */
-                corrs(i, j, t) = trace((expand(exp((tau-beta)*spectrum.energies), spectrum.size())
-                                        % Ai)
-                                       * (expand(exp(-tau*spectrum.energies), spectrum.size())
-                                          % trans(Aj)))
-                                 / normalisation;
+            double totalMagnitude = 0.0;
+            for (std::size_t k = 0; k < residues.size(); ++k) {
+                totalMagnitude += magnitude(Pole{residues.frequencies[k],
+                                                 residues.weight(k, inverseTemperature) / normalisations[b]});
+            }
+
+            auto &merged = poles[b](i, j);
+            for (std::size_t g = 0; g + 1 < groupBegins.size(); ++g) {
+                Pole pole{0.0, 0.0};
+                for (std::size_t k = groupBegins[g]; k < groupBegins[g + 1]; ++k) {
+                    pole.frequency += residues.frequencies[order[k]];
+                    pole.weight += residues.weight(order[k], inverseTemperature) / normalisations[b];
+                }
+                pole.frequency /= static_cast<double>(groupBegins[g + 1] - groupBegins[g]);
+
+                // Contributions of degenerate states can cancel due to symmetries.
+                if (magnitude(pole) > 1e-14 * totalMagnitude) {
+                    merged.push_back(pole);
+                }
             }
         }
+    });
+
+    return poles;
+}
+
+
+double sumRuleViolation(Correlators const &correlators)
+{
+    double violation = 0.0;
+    for (std::size_t i = 0; i < correlators.numSites; ++i) {
+        double const sum = correlators(i, i, 0) + correlators(i, i, correlators.timeLattice.nt - 1);
+        violation = std::max(violation, std::abs(sum - 1.0));
     }
+    return violation;
+}
 
-    return corrs;
+
+double sumRuleViolation(CorrelatorPoles const &poles)
+{
+    double violation = 0.0;
+    for (std::size_t i = 0; i < poles.numSites; ++i) {
+        double sum = 0.0;
+        for (auto const &pole : poles(i, i)) {
+            sum += pole.weight * (1.0 + std::exp(-poles.beta * pole.frequency));
+        }
+        violation = std::max(violation, std::abs(sum - 1.0));
+    }
+    return violation;
 }
@@ -8,28 +8,45 @@
 #include <cassert>
 #include <vector>
 
+#include "checkpoint.hpp"
 #include "config.hpp"
+#include "lattice.hpp"
 #include "spectrum.hpp"
 
 
+/// Inverse temperature and number of time slices.
+struct TimeLattice
+{
+    /// Inverse temperature.
+    double beta;
+    /// Number of time slices, tau = beta t / (nt-1) for t in [0, nt).
+    std::size_t nt;
+};
+
+
+/// Correlators on all pairs of sites and time slices of one TimeLattice.
 struct Correlators
 {
+    std::size_t numSites;
+    TimeLattice timeLattice;
+    HubbardParameters parameters;
     std::vector<double> data;
 
 
-    explicit Correlators()
-            : data(NSITES * NSITES * NT)
+    Correlators(TimeLattice const &inTimeLattice, HubbardParameters const &inParameters)
+            : numSites{lattice().numSites()}, timeLattice{inTimeLattice}, parameters{inParameters},
+              data(numSites * numSites * inTimeLattice.nt)
     { }
 
 
-    [[nodiscard]] static std::size_t totalIndex(std::size_t const i,
-                                                std::size_t const j,
-                                                std::size_t const t) noexcept
+    [[nodiscard]] std::size_t totalIndex(std::size_t const i,
+                                         std::size_t const j,
+                                         std::size_t const t) const noexcept
     {
-        assert(i < NSITES);
-        assert(j < NSITES);
-        assert(t < NT);
-        return (i*NSITES + j)*NT + t;
+        assert(i < numSites);
+        assert(j < numSites);
+        assert(t < timeLattice.nt);
+        return (i*numSites + j)*timeLattice.nt + t;
     }
 
 
@@ -51,6 +68,93 @@ struct Correlators
 };
 
 
-Correlators computeCorrelators(Spectrum const &spectrum);
+/// A single term \f$ w e^{-\tau\omega} \f$ in the Lehmann representation of a correlator.
+struct Pole
+{
+    /// \f$ \omega = E_\gamma - E_\alpha \f$.
+    double frequency;
+    /// \f$ w = e^{-\beta E_\alpha} A_i^{\alpha\gamma} A_j^{\alpha\gamma} / Z \f$.
+    double weight;
+};
+
+
+/**
+ * Lehmann representation of all correlators at inverse temperature `beta`,
+ * \f$ C_{ij}(\tau) = \sum_k w_k e^{-\tau\omega_k} \f$
+ * with poles \f$ (\omega_k, w_k) \f$ stored in `poles(i, j)`.
+ */
+struct CorrelatorPoles
+{
+    std::size_t numSites;
+    double beta;
+    HubbardParameters parameters;
+    std::vector<std::vector<Pole>> data;
+
+
+    CorrelatorPoles(double const inBeta, HubbardParameters const &inParameters)
+            : numSites{lattice().numSites()}, beta{inBeta}, parameters{inParameters},
+              data(numSites * numSites)
+    { }
+
+
+    std::vector<Pole> const &operator()(std::size_t const i,
+                                        std::size_t const j) const noexcept
+    {
+        assert(i < numSites);
+        assert(j < numSites);
+        return data[i*numSites + j];
+    }
+
+
+    std::vector<Pole> &operator()(std::size_t const i,
+                                  std::size_t const j) noexcept
+    {
+        assert(i < numSites);
+        assert(j < numSites);
+        return data[i*numSites + j];
+    }
+};
+
+
+/**
+ * Compute correlators for several time lattices from one spectrum.
+ *
+ * Matrix elements of annihilators in the eigenbasis are computed only once
+ * and shared between all time lattices.
+ * \param checkpoint If not null, load correlators of pairs of sites that have already
+ *                   been computed from it and store all newly computed pairs in it.
+ * \return One set of correlators per element of `timeLattices`.
+ */
+std::vector<Correlators> computeCorrelators(Spectrum const &spectrum,
+                                            std::vector<TimeLattice> const &timeLattices,
+                                            Checkpoint const *checkpoint = nullptr);
+
+
+/**
+ * Compute the Lehmann representation of correlators for several inverse temperatures.
+ *
+ * Poles whose frequencies differ by at most `tolerance * max(1, |omega|)` are merged
+ * into one pole with the sum of their weights.
+ * Merged poles whose weights cancel are dropped.
+ * \return One set of poles per element of `betas`.
+ */
+std::vector<CorrelatorPoles> computeCorrelatorPoles(Spectrum const &spectrum,
+                                                    std::vector<double> const &betas,
+                                                    double tolerance = 1e-10);
+
+
+
+/**
+ * Return how much correlators violate the sum rule
+ * \f$ C_{ii}(0) + C_{ii}(\beta) = \langle a_i a_i^\dagger + a_i^\dagger a_i \rangle = 1 \f$.
+ *
+ * It holds for the full spectrum, so a violation measures the error
+ * from truncating the spectrum with Eigensolver::lanczos or `--max-charge`.
+ * \return Maximum of \f$ |C_{ii}(0) + C_{ii}(\beta) - 1| \f$ over all sites.
+ */
+double sumRuleViolation(Correlators const &correlators);
+
+/// Like sumRuleViolation(Correlators const &) but for the Lehmann representation.
+double sumRuleViolation(CorrelatorPoles const &poles);
 
 #endif //EXACT_HUBBARD_CORRELATORS_HPP
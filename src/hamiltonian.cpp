@@ -0,0 +1,38 @@
+#include "hamiltonian.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+#include "config_tables.hpp"
+
+
+HubbardHamiltonian::HubbardHamiltonian(double const inKappa, double const inU)
+        : halfU_{inU / 2.0}
+{
+    auto const &links = lattice().links();
+    auto const &hoppings = lattice().hoppings();
+    hops_.reserve(2 * links.size());
+
+#ifdef EXACT_HUBBARD_CONSTEXPR_TABLES
+    bool const precomputed = isConfigLattice(lattice());
+#endif
+
+    // particles use the even bits, holes the odd ones
+    for (std::size_t const offset : {std::size_t{0}, std::size_t{1}}) {
+        double const sign = offset == 0 ? -1.0 : +1.0;
+        for (std::size_t l = 0; l < links.size(); ++l) {
+            double const coef = sign * inKappa * hoppings[l];
+#ifdef EXACT_HUBBARD_CONSTEXPR_TABLES
+            if (precomputed) {
+                hops_.push_back({configHopMasks[offset * links.size() + l], coef});
+                continue;
+            }
+#endif
+            auto const [a, b] = links[l];
+            // The masks flip one bit on each site, Lattice rejects self-links.
+            assert(a != b);
+            hops_.push_back({hopMasks(2 * std::min(a, b) + offset, 2 * std::max(a, b) + offset),
+                             coef});
+        }
+    }
+}
@@ -0,0 +1,128 @@
+#ifndef EXACT_HUBBARD_HAMILTONIAN_HPP
+#define EXACT_HUBBARD_HAMILTONIAN_HPP
+
+/** \file
+ * \brief Fused operator for the full Hamiltonian.
+ */
+
+#include <vector>
+
+#include "config.hpp"
+#include "operator.hpp"
+#include "state.hpp"
+
+
+/// Bit masks that describe a hop of a particle or hole along a link, see HubbardHamiltonian.
+struct HopMasks
+{
+    /// The two bits of the sites of the link.
+    State::Words flip;
+    /// All bits strictly between the bits in `flip`.
+    State::Words between;
+};
+
+
+/**
+ * Compute the masks of a hop between two bits.
+ * \param low Lower bit, `2*site` for particles and `2*site+1` for holes.
+ * \param high Higher bit of the same kind as `low`.
+ */
+constexpr HopMasks hopMasks(std::size_t const low, std::size_t const high) noexcept
+{
+    auto const setBit = [](State &state, std::size_t const bit) {
+        if (bit % 2 == 0) {
+            state.addParticleOn(bit / 2);
+        }
+        else {
+            state.addHoleOn(bit / 2);
+        }
+    };
+
+    State flip;
+    setBit(flip, low);
+    setBit(flip, high);
+    State between;
+    for (std::size_t bit = low + 1; bit < high; ++bit) {
+        setBit(between, bit);
+    }
+    return {flip.words(), between.words()};
+}
+
+
+/**
+ * The Hamiltonian
+ * \f[
+   H = -\kappa \sum_{\langle x, y\rangle}\, w_{xy} a_x^\dagger a_y
+       + \kappa \sum_{\langle x, y\rangle}\, w_{xy} b_x^\dagger b_y
+       + \frac{U}{2} \sum_x (n_x - \tilde{n}_x)^2
+ * \f]
+ * as a single operator.
+ *
+ * Produces the same output as
+ * `SumOperator{ParticleHop{kappa}, HoleHop{kappa}, SquaredNumberOperator{U}}`
+ * but does not test sites and count operators one at a time.
+ * Instead, every hop along a link of lattice() is turned into bit masks on construction:
+ * The hop is possible iff exactly one of the two bits of the link is set,
+ * it flips both bits, and its sign is the parity of the number of set bits
+ * strictly between them.
+ * So each hop only costs a few AND, XOR, and popcount instructions on the words of a state.
+ * If EXACT_HUBBARD_CONSTEXPR_TABLES is defined, the masks for the lattice in config.hpp
+ * are taken from configHopMasks.
+ */
+struct HubbardHamiltonian : Operator<HubbardHamiltonian>
+{
+    constexpr static bool hermitian = true;
+
+
+    /// Precompute hops for lattice(), kappa and U default to the values in config.hpp.
+    explicit HubbardHamiltonian(double inKappa = ::kappa, double inU = ::U);
+
+
+    /// Implementation of apply.
+    void apply_implSingleOutparam(State const &state, SumState &out) const
+    {
+        auto const &words = state.words();
+        for (auto const &hop : hops_) {
+            int numFlipped = 0;
+            int numBetween = 0;
+            for (std::size_t w = 0; w < State::numWords; ++w) {
+                numFlipped += popcount(words[w] & hop.flip[w]);
+                numBetween += popcount(words[w] & hop.between[w]);
+            }
+            if (numFlipped == 1) {
+                State::Words newWords{};
+                for (std::size_t w = 0; w < State::numWords; ++w) {
+                    newWords[w] = words[w] ^ hop.flip[w];
+                }
+                out.push(numBetween % 2 == 0 ? hop.coef : -hop.coef, State{newWords});
+            }
+        }
+
+        if (halfU_ != 0.0) {
+            if (int const number = state.numChargedSites(); number != 0) {
+                out.push(halfU_ * static_cast<double>(number), state);
+            }
+        }
+    }
+
+
+    /// Every link allows one particle and one hole hop, plus the diagonal.
+    [[nodiscard]] std::size_t maxOutputsPerState_impl() const noexcept
+    {
+        return hops_.size() + 1;
+    }
+
+
+private:
+    /// Hop of a particle or hole in either direction along a link.
+    struct Hop : HopMasks
+    {
+        /// Hopping weight times kappa including the sign of the particle or hole term.
+        double coef;
+    };
+
+    std::vector<Hop> hops_;
+    double halfU_;
+};
+
+#endif //EXACT_HUBBARD_HAMILTONIAN_HPP
@@ -0,0 +1,73 @@
+#ifndef EXACT_HUBBARD_HASH_HPP
+#define EXACT_HUBBARD_HASH_HPP
+
+/** \file
+ * \brief Hashes for identifying parameters of computations.
+ */
+
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <string>
+
+
+/**
+ * Incremental 64-bit FNV-1a hash.
+ *
+ * Not cryptographic, only meant to tell apart parameters of computations.
+ * Values are hashed via their bit patterns, so results are platform independent
+ * for little-endian IEEE 754 machines.
+ */
+class Hasher
+{
+public:
+    /// Add an unsigned integer.
+    void add(std::uint64_t const x) noexcept
+    {
+        for (std::size_t byte = 0; byte < sizeof x; ++byte) {
+            hash_ = (hash_ ^ ((x >> (8 * byte)) & 0xff)) * 0x100'0000'01b3;
+        }
+    }
+
+
+    /// Add a floating point number.
+    void add(double const x) noexcept
+    {
+        std::uint64_t bits;
+        std::memcpy(&bits, &x, sizeof bits);
+        add(bits);
+    }
+
+
+    /// Add a string including its length.
+    void add(std::string const &str) noexcept
+    {
+        add(std::uint64_t{str.size()});
+        for (auto const c : str) {
+            add(std::uint64_t{static_cast<unsigned char>(c)});
+        }
+    }
+
+
+    /// Return the hash of everything added so far.
+    [[nodiscard]] std::uint64_t hash() const noexcept
+    {
+        return hash_;
+    }
+
+
+    /// Return the hash as a string of 16 hexadecimal digits.
+    [[nodiscard]] std::string hexDigest() const
+    {
+        std::ostringstream oss;
+        oss << std::hex << std::setw(16) << std::setfill('0') << hash_;
+        return oss.str();
+    }
+
+
+private:
+    std::uint64_t hash_ = 0xcbf2'9ce4'8422'2325;
+};
+
+#endif //EXACT_HUBBARD_HASH_HPP
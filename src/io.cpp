@@ -1,7 +1,19 @@
 #include "io.hpp"
 
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
 #include <fstream>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
 
+#include "lattice.hpp"
 
 
 std::ostream &operator<<(std::ostream &os, PH ph)
@@ -44,10 +56,30 @@ std::ostream &operator<<(std::ostream &os, SumState const &states)
 }
 
 
+void writeAtomically(fs::path const &fname, std::function<void(fs::path const &)> const &write)
+{
+    // random suffix so that concurrent writers of the same file do not interfere
+    auto tmpFile = fname;
+    tmpFile += ".tmp" + std::to_string(std::random_device{}());
+    try {
+        write(tmpFile);
+        fs::rename(tmpFile, fname);
+    }
+    catch (...) {
+        std::error_code ec;
+        fs::remove(tmpFile, ec);
+        throw;
+    }
+}
+
+
 void saveSpectrum(fs::path const &fname, Spectrum const &spectrum)
 {
     std::ofstream ofs(fname);
-    ofs << "#  Q  E\n";
+    // parameters are commented out to keep the file loadable as a plain table
+    ofs << "#  U  kappa\n# "
+        << spectrum.parameters.U << ' ' << spectrum.parameters.kappa
+        << "\n#  Q  E\n";
     for (std::size_t i = 0; i < spectrum.size(); ++i) {
         ofs << spectrum.charges[i] << ' ' << spectrum.energies[i] << '\n';
     }
@@ -58,11 +90,449 @@ void saveCorrelators(fs::path const &fname, Correlators const &correlators)
 {
     std::ofstream ofs{fname};
     ofs << "#~ correlator\n#  nx  nt\n"
-        << NSITES << ' ' << NT
+        << correlators.numSites << ' ' << correlators.timeLattice.nt
         << "\n#  U  kappa  beta\n"
-        << U << ' ' << kappa << ' ' << beta
+        << correlators.parameters.U << ' ' << correlators.parameters.kappa << ' '
+        << correlators.timeLattice.beta
         << "\n#  data\n";
     for (auto const x : correlators.data) {
         ofs << x << ' ';
     }
 }
+
+
+void savePoles(fs::path const &fname, CorrelatorPoles const &poles)
+{
+    std::ofstream ofs{fname};
+    ofs.precision(std::numeric_limits<double>::max_digits10);
+    ofs << "#~ poles\n#  nx\n"
+        << poles.numSites
+        << "\n#  U  kappa  beta\n"
+        << poles.parameters.U << ' ' << poles.parameters.kappa << ' ' << poles.beta
+        << "\n#  i  j  omega  weight\n";
+    for (std::size_t i = 0; i < poles.numSites; ++i) {
+        for (std::size_t j = 0; j < poles.numSites; ++j) {
+            for (auto const &pole : poles(i, j)) {
+                ofs << i << ' ' << j << ' ' << pole.frequency << ' ' << pole.weight << '\n';
+            }
+        }
+    }
+}
+
+
+namespace {
+#if defined __BYTE_ORDER__
+    static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__,
+                  "Binary files are written in native byte order which must be little-endian.");
+#endif
+
+    constexpr char binaryMagic[8] = {'E', 'X', 'H', 'U', 'B', 'B', 'I', 'N'};
+    constexpr std::uint32_t binaryVersion = 1;
+    constexpr std::size_t binaryHeaderSize = 64;
+    constexpr std::size_t binaryTableEntrySize = 96;
+    constexpr std::size_t binaryNameSize = 32;
+    constexpr std::size_t binaryTypeSize = 8;
+    constexpr std::size_t binaryMaxDims = 4;
+    /// Alignment of arrays in the file, enough for cache lines and SIMD loads from mmap.
+    constexpr std::size_t binaryAlignment = 64;
+
+
+    template <typename T>
+    constexpr char const *typeString() noexcept;
+
+    template <>
+    constexpr char const *typeString<double>() noexcept
+    {
+        return "<f8";
+    }
+
+    template <>
+    constexpr char const *typeString<std::int64_t>() noexcept
+    {
+        return "<i8";
+    }
+
+    template <>
+    constexpr char const *typeString<std::uint64_t>() noexcept
+    {
+        return "<u8";
+    }
+
+
+    /// Description of an array to be written to a binary file, does not own the data.
+    struct BinaryArray
+    {
+        std::string name;
+        char const *type;
+        std::vector<std::uint64_t> shape;
+        char const *data;
+        std::size_t numBytes;
+    };
+
+
+    template <typename T>
+    BinaryArray binaryArray(std::string name, std::vector<std::uint64_t> shape, T const *data)
+    {
+        assert(name.size() < binaryNameSize);
+        assert(shape.size() <= binaryMaxDims);
+        std::size_t numElements = 1;
+        for (auto const n : shape) {
+            numElements *= n;
+        }
+        return {std::move(name), typeString<T>(), std::move(shape),
+                reinterpret_cast<char const *>(data), numElements * sizeof(T)};
+    }
+
+
+    /// Scalar values stored in the header of binary files.
+    struct BinaryMetadata
+    {
+        std::size_t numSites;
+        HubbardParameters parameters;
+        double beta = std::numeric_limits<double>::quiet_NaN();
+        std::size_t nt = 0;
+    };
+
+
+    template <typename T>
+    void writeRaw(std::ostream &os, T const &x)
+    {
+        os.write(reinterpret_cast<char const *>(&x), sizeof(T));
+    }
+
+
+    void writeUInt64(std::ostream &os, std::uint64_t const x)
+    {
+        writeRaw(os, x);
+    }
+
+
+    void writeZeros(std::ostream &os, std::size_t const n)
+    {
+        static constexpr char zeros[binaryAlignment]{};
+        assert(n <= binaryAlignment);
+        os.write(zeros, static_cast<std::streamsize>(n));
+    }
+
+
+    void writeString(std::ostream &os, std::string const &str, std::size_t const size)
+    {
+        assert(str.size() <= size);
+        os.write(str.data(), static_cast<std::streamsize>(str.size()));
+        writeZeros(os, size - str.size());
+    }
+
+
+    constexpr std::size_t alignUp(std::size_t const n) noexcept
+    {
+        return (n + binaryAlignment - 1) / binaryAlignment * binaryAlignment;
+    }
+
+
+    /// Write a binary file, see saveSpectrumBinary for the format.
+    void saveBinary(fs::path const &fname, BinaryMetadata const &metadata,
+                    std::vector<BinaryArray> const &arrays)
+    {
+        std::ofstream ofs{fname, std::ios::binary};
+        if (not ofs) {
+            throw std::runtime_error("Cannot open file for writing: " + fname.string());
+        }
+
+        ofs.write(binaryMagic, sizeof binaryMagic);
+        writeRaw(ofs, binaryVersion);
+        writeRaw(ofs, static_cast<std::uint32_t>(arrays.size()));
+        writeUInt64(ofs, metadata.numSites);
+        writeRaw(ofs, metadata.parameters.U);
+        writeRaw(ofs, metadata.parameters.kappa);
+        writeRaw(ofs, metadata.beta);
+        writeUInt64(ofs, metadata.nt);
+        writeZeros(ofs, binaryHeaderSize - sizeof binaryMagic - 2 * sizeof(std::uint32_t)
+                        - 5 * sizeof(std::uint64_t));
+
+        std::size_t const tableEnd = binaryHeaderSize + arrays.size() * binaryTableEntrySize;
+        std::size_t offset = alignUp(tableEnd);
+        for (auto const &array : arrays) {
+            writeString(ofs, array.name, binaryNameSize);
+            writeString(ofs, array.type, binaryTypeSize);
+            writeUInt64(ofs, array.shape.size());
+            for (std::size_t d = 0; d < binaryMaxDims; ++d) {
+                writeUInt64(ofs, d < array.shape.size() ? array.shape[d] : 0);
+            }
+            writeUInt64(ofs, offset);
+            writeZeros(ofs, binaryTableEntrySize - binaryNameSize - binaryTypeSize
+                            - (binaryMaxDims + 2) * sizeof(std::uint64_t));
+            offset = alignUp(offset + array.numBytes);
+        }
+
+        std::size_t position = tableEnd;
+        for (auto const &array : arrays) {
+            writeZeros(ofs, alignUp(position) - position);
+            ofs.write(array.data, static_cast<std::streamsize>(array.numBytes));
+            position = alignUp(position) + array.numBytes;
+        }
+
+        if (not ofs) {
+            throw std::runtime_error("Failed to write file " + fname.string());
+        }
+    }
+
+
+    /// Flatten the links of the lattice into pairs of sites.
+    std::vector<std::uint64_t> flatLinks()
+    {
+        std::vector<std::uint64_t> links;
+        links.reserve(2 * lattice().links().size());
+        for (auto const &[a, b] : lattice().links()) {
+            links.push_back(a);
+            links.push_back(b);
+        }
+        return links;
+    }
+}
+
+
+void saveSpectrumBinary(fs::path const &fname, Spectrum const &spectrum,
+                        bool const withEigenvectors)
+{
+    auto const links = flatLinks();
+    std::uint64_t const numLinks = lattice().links().size();
+
+    std::vector<std::int64_t> sectors;
+    sectors.reserve(6 * spectrum.sectors.size());
+    for (auto const &sector : spectrum.sectors) {
+        sectors.insert(sectors.end(), {sector.numParticles, sector.numHoles,
+                                       static_cast<std::int64_t>(sector.offset),
+                                       static_cast<std::int64_t>(sector.size),
+                                       static_cast<std::int64_t>(sector.eigenstateOffset),
+                                       static_cast<std::int64_t>(sector.numEigenstates)});
+    }
+
+    std::uint64_t const numEigenstates = spectrum.size();
+    std::vector<std::int64_t> const charges(spectrum.charges.begin(), spectrum.charges.end());
+
+    std::vector<BinaryArray> arrays{
+            binaryArray("links", {numLinks, 2}, links.data()),
+            binaryArray("hoppings", {numLinks}, lattice().hoppings().data()),
+            binaryArray("sectors", {spectrum.sectors.size(), 6}, sectors.data()),
+            binaryArray("charges", {numEigenstates}, charges.data()),
+            binaryArray("energies", {numEigenstates}, spectrum.energies.data())
+    };
+
+    std::vector<std::uint64_t> basisStates;
+    std::vector<double> basisCoefficients;
+    std::vector<std::uint64_t> offsets;
+    std::vector<std::uint64_t> indices;
+    std::vector<double> coefficients;
+    if (withEigenvectors) {
+        std::uint64_t const basisSize = spectrum.basis.size();
+        basisStates.reserve(basisSize * State::numWords);
+        basisCoefficients.reserve(basisSize);
+        for (std::size_t i = 0; i < basisSize; ++i) {
+            auto const [coef, state] = spectrum.basis[i];
+            basisStates.insert(basisStates.end(), state.words().begin(), state.words().end());
+            basisCoefficients.push_back(coef);
+        }
+
+        offsets.reserve(numEigenstates + 1);
+        offsets.push_back(0);
+        for (std::size_t i = 0; i < numEigenstates; ++i) {
+            indices.insert(indices.end(), spectrum.eigenStateIdxs[i].begin(),
+                           spectrum.eigenStateIdxs[i].end());
+            coefficients.insert(coefficients.end(), spectrum.eigenStateCoeffs[i].begin(),
+                                spectrum.eigenStateCoeffs[i].end());
+            offsets.push_back(indices.size());
+        }
+
+        arrays.push_back(binaryArray("basis_states", {basisSize, State::numWords},
+                                     basisStates.data()));
+        arrays.push_back(binaryArray("basis_coefficients", {basisSize},
+                                     basisCoefficients.data()));
+        arrays.push_back(binaryArray("eigenvector_offsets", {offsets.size()}, offsets.data()));
+        arrays.push_back(binaryArray("eigenvector_indices", {indices.size()}, indices.data()));
+        arrays.push_back(binaryArray("eigenvector_coefficients", {coefficients.size()},
+                                     coefficients.data()));
+    }
+
+    saveBinary(fname, {lattice().numSites(), spectrum.parameters}, arrays);
+}
+
+
+namespace {
+    /// Entry of the array table of a binary file.
+    struct BinaryTableEntry
+    {
+        std::string type;
+        std::vector<std::uint64_t> shape;
+        std::uint64_t offset;
+    };
+
+
+    template <typename T>
+    T readRaw(std::istream &is)
+    {
+        T x;
+        is.read(reinterpret_cast<char *>(&x), sizeof(T));
+        return x;
+    }
+
+
+    std::string readString(std::istream &is, std::size_t const size)
+    {
+        std::string str(size, '\0');
+        is.read(str.data(), static_cast<std::streamsize>(size));
+        str.resize(str.find('\0') == std::string::npos ? size : str.find('\0'));
+        return str;
+    }
+
+
+    /// Read an array with a given name and number of dimensions from a binary file.
+    template <typename T>
+    std::vector<T> readArray(std::istream &is,
+                             std::map<std::string, BinaryTableEntry> const &table,
+                             std::string const &name, std::size_t const ndim,
+                             fs::path const &fname)
+    {
+        auto const it = table.find(name);
+        if (it == table.end()) {
+            throw std::runtime_error("Array " + name + " is missing in " + fname.string());
+        }
+        auto const &entry = it->second;
+        if (entry.type != typeString<T>() or entry.shape.size() != ndim) {
+            throw std::runtime_error("Array " + name + " has the wrong type in "
+                                     + fname.string());
+        }
+
+        std::size_t numElements = 1;
+        for (auto const n : entry.shape) {
+            numElements *= n;
+        }
+        std::vector<T> array(numElements);
+        is.seekg(static_cast<std::streamoff>(entry.offset));
+        is.read(reinterpret_cast<char *>(array.data()),
+                static_cast<std::streamsize>(numElements * sizeof(T)));
+        if (not is) {
+            throw std::runtime_error("Failed to read array " + name + " from " + fname.string());
+        }
+        return array;
+    }
+}
+
+
+Spectrum loadSpectrumBinary(fs::path const &fname)
+{
+    std::ifstream ifs{fname, std::ios::binary};
+    if (not ifs) {
+        throw std::runtime_error("Cannot open file for reading: " + fname.string());
+    }
+
+    char magic[sizeof binaryMagic];
+    ifs.read(magic, sizeof magic);
+    if (not ifs or not std::equal(std::begin(magic), std::end(magic), std::begin(binaryMagic))
+        or readRaw<std::uint32_t>(ifs) != binaryVersion) {
+        throw std::runtime_error("Not a binary file of a supported version: " + fname.string());
+    }
+    auto const numArrays = readRaw<std::uint32_t>(ifs);
+    readRaw<std::uint64_t>(ifs);  // number of sites
+    HubbardParameters parameters;
+    parameters.U = readRaw<double>(ifs);
+    parameters.kappa = readRaw<double>(ifs);
+
+    std::map<std::string, BinaryTableEntry> table;
+    ifs.seekg(binaryHeaderSize);
+    for (std::uint32_t a = 0; a < numArrays; ++a) {
+        auto const name = readString(ifs, binaryNameSize);
+        BinaryTableEntry entry;
+        entry.type = readString(ifs, binaryTypeSize);
+        entry.shape.resize(readRaw<std::uint64_t>(ifs));
+        for (std::size_t d = 0; d < binaryMaxDims; ++d) {
+            auto const n = readRaw<std::uint64_t>(ifs);
+            if (d < entry.shape.size()) {
+                entry.shape[d] = n;
+            }
+        }
+        entry.offset = readRaw<std::uint64_t>(ifs);
+        ifs.ignore(binaryTableEntrySize - binaryNameSize - binaryTypeSize
+                   - (binaryMaxDims + 2) * sizeof(std::uint64_t));
+        table.emplace(name, std::move(entry));
+    }
+    if (not ifs) {
+        throw std::runtime_error("Failed to read array table from " + fname.string());
+    }
+
+    auto const rawSectors = readArray<std::int64_t>(ifs, table, "sectors", 2, fname);
+    auto const rawEnergies = readArray<double>(ifs, table, "energies", 1, fname);
+    auto const basisStates = readArray<std::uint64_t>(ifs, table, "basis_states", 2, fname);
+    auto const basisCoefficients = readArray<double>(ifs, table, "basis_coefficients", 1,
+                                                     fname);
+    auto const offsets = readArray<std::uint64_t>(ifs, table, "eigenvector_offsets", 1, fname);
+    auto const indices = readArray<std::uint64_t>(ifs, table, "eigenvector_indices", 1, fname);
+    auto const coefficients = readArray<double>(ifs, table, "eigenvector_coefficients", 1,
+                                                fname);
+
+    if (table.at("sectors").shape[1] != 6
+        or table.at("basis_states").shape[1] != State::numWords
+        or basisStates.size() != basisCoefficients.size() * State::numWords
+        or offsets.size() != rawEnergies.size() + 1
+        or offsets.back() != indices.size() or indices.size() != coefficients.size()) {
+        throw std::runtime_error("Inconsistent array sizes in " + fname.string());
+    }
+
+    SumState basis;
+    basis.reserve(basisCoefficients.size());
+    for (std::size_t i = 0; i < basisCoefficients.size(); ++i) {
+        State::Words words;
+        std::copy_n(basisStates.begin() + static_cast<std::ptrdiff_t>(i * State::numWords),
+                    State::numWords, words.begin());
+        basis.push(basisCoefficients[i], State{words});
+    }
+
+    std::vector<Sector> sectors;
+    for (std::size_t s = 0; s < rawSectors.size(); s += 6) {
+        sectors.push_back(Sector{static_cast<int>(rawSectors[s]),
+                                 static_cast<int>(rawSectors[s + 1]),
+                                 static_cast<std::size_t>(rawSectors[s + 2]),
+                                 static_cast<std::size_t>(rawSectors[s + 3]),
+                                 static_cast<std::size_t>(rawSectors[s + 4]),
+                                 static_cast<std::size_t>(rawSectors[s + 5])});
+    }
+
+    DVector energies(rawEnergies.size());
+    std::copy(rawEnergies.begin(), rawEnergies.end(), energies.begin());
+
+    std::vector<std::vector<std::size_t>> eigenStateIdxs(rawEnergies.size());
+    std::vector<std::vector<double>> eigenStateCoeffs(rawEnergies.size());
+    for (std::size_t i = 0; i < rawEnergies.size(); ++i) {
+        auto const begin = static_cast<std::ptrdiff_t>(offsets[i]);
+        auto const end = static_cast<std::ptrdiff_t>(offsets[i + 1]);
+        if (begin > end) {
+            throw std::runtime_error("Inconsistent eigenvector offsets in " + fname.string());
+        }
+        eigenStateIdxs[i].assign(indices.begin() + begin, indices.begin() + end);
+        eigenStateCoeffs[i].assign(coefficients.begin() + begin, coefficients.begin() + end);
+    }
+
+    try {
+        return Spectrum::fromEigenstates(std::move(basis), parameters, std::move(sectors),
+                                         std::move(energies), std::move(eigenStateIdxs),
+                                         std::move(eigenStateCoeffs));
+    }
+    catch (std::invalid_argument const &err) {
+        throw std::runtime_error("Invalid spectrum in " + fname.string() + ": " + err.what());
+    }
+}
+
+
+void saveCorrelatorsBinary(fs::path const &fname, Correlators const &correlators)
+{
+    auto const links = flatLinks();
+    std::uint64_t const numLinks = lattice().links().size();
+    std::uint64_t const nx = correlators.numSites;
+
+    saveBinary(fname,
+               {correlators.numSites, correlators.parameters,
+                correlators.timeLattice.beta, correlators.timeLattice.nt},
+               {binaryArray("links", {numLinks, 2}, links.data()),
+                binaryArray("hoppings", {numLinks}, lattice().hoppings().data()),
+                binaryArray("correlators", {nx, nx, correlators.timeLattice.nt},
+                            correlators.data.data())});
+}
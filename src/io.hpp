@@ -6,6 +6,7 @@
  */
 
 #include <filesystem>
+#include <functional>
 #include <ostream>
 
 #include "correlators.hpp"
@@ -27,6 +28,15 @@ std::ostream &operator<<(std::ostream &os, State const &state);
 std::ostream &operator<<(std::ostream &os, SumState const &states);
 
 
+/**
+ * Write a file via a temporary file in the same directory.
+ *
+ * `write` is called with the name of the temporary file which is renamed to `fname`
+ * afterwards, so `fname` never contains incomplete data, even if the program is aborted.
+ */
+void writeAtomically(fs::path const &fname, std::function<void(fs::path const &)> const &write);
+
+
 /// Write a Spectrum to file.
 void saveSpectrum(fs::path const &fname, Spectrum const &spectrum);
 
@@ -34,4 +44,61 @@ void saveSpectrum(fs::path const &fname, Spectrum const &spectrum);
 /// Write correlators to file.
 void saveCorrelators(fs::path const &fname, Correlators const &correlators);
 
+
+/// Write poles of correlators to file.
+void savePoles(fs::path const &fname, CorrelatorPoles const &poles);
+
+
+/**
+ * Write a Spectrum to a binary file.
+ *
+ * The file starts with a fixed header of 64 bytes, all numbers are little-endian:
+ *  - `char[8]` magic bytes `EXHUBBIN`
+ *  - `uint32` format version, currently 1
+ *  - `uint32` number of arrays
+ *  - `uint64` number of sites
+ *  - `float64` U, kappa, beta (NaN if not applicable)
+ *  - `uint64` number of time slices (0 if not applicable)
+ *
+ * It is followed by a table with one entry of 96 bytes per array:
+ *  - `char[32]` name, padded with zeros
+ *  - `char[8]` numpy type string, e.g. `<f8`, padded with zeros
+ *  - `uint64` number of dimensions (at most 4)
+ *  - `uint64[4]` shape in C order, unused dimensions are 0
+ *  - `uint64` offset of the data from the start of the file, a multiple of 64
+ *
+ * Spectrum files contain the arrays
+ *  - `links` (`uint64`, `[numLinks, 2]`) and `hoppings` (`float64`, `[numLinks]`) of the lattice,
+ *  - `sectors` (`int64`, `[numSectors, 6]`) with columns numParticles, numHoles,
+ *    offset, size, eigenstateOffset, numEigenstates, see Sector,
+ *  - `charges` (`int64`) and `energies` (`float64`) of all eigenstates.
+ *
+ * If `withEigenvectors` is `true`, the basis and eigenvectors are stored as well:
+ *  - `basis_states` (`uint64`, `[basisSize, State::numWords]`) raw words of basis states,
+ *  - `basis_coefficients` (`float64`) coefficients of basis states,
+ *  - `eigenvector_offsets` (`uint64`, `[numEigenstates + 1]`),
+ *    `eigenvector_indices` (`uint64`) and `eigenvector_coefficients` (`float64`)
+ *    hold Spectrum::eigenStateIdxs and Spectrum::eigenStateCoeffs in compressed row format.
+ */
+void saveSpectrumBinary(fs::path const &fname, Spectrum const &spectrum, bool withEigenvectors);
+
+
+/**
+ * Read a Spectrum from a binary file written by saveSpectrumBinary.
+ *
+ * The file must have been written with eigenvectors and by a program with the same
+ * State::numWords.
+ * \throws std::runtime_error if the file cannot be read or does not contain a spectrum.
+ */
+Spectrum loadSpectrumBinary(fs::path const &fname);
+
+
+/**
+ * Write correlators to a binary file.
+ *
+ * Uses the same format as saveSpectrumBinary with arrays `links`, `hoppings`,
+ * and `correlators` (`float64`, `[nx, nx, nt]`).
+ */
+void saveCorrelatorsBinary(fs::path const &fname, Correlators const &correlators);
+
 #endif //EXACT_HUBBARD_IO_HPP
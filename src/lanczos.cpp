@@ -0,0 +1,311 @@
+#include "lanczos.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <random>
+#include <stdexcept>
+
+#include <blaze/math/lapack/syev.h>
+#include <blaze/math/Submatrix.h>
+
+
+namespace {
+    /// A set of vectors.
+    using Block = std::vector<DVector>;
+
+    /**
+     * Vectors whose norm shrinks by more than this factor during orthogonalisation
+     * are considered to be linearly dependent.
+     */
+    constexpr double dependenceThreshold = 1e-10;
+
+
+    /**
+     * Remove components along `basis` from `v`.
+     * Orthogonalises twice to keep orthogonality at machine precision.
+     * \return Overlaps of `v` with each vector in `basis` before orthogonalisation.
+     */
+    std::vector<double> orthogonalise(DVector &v, Block const &basis)
+    {
+        std::vector<double> overlaps(basis.size(), 0.0);
+        for (int pass = 0; pass < 2; ++pass) {
+            for (std::size_t i = 0; i < basis.size(); ++i) {
+                double const overlap = dot(basis[i], v);
+                v -= overlap * basis[i];
+                overlaps[i] += overlap;
+            }
+        }
+        return overlaps;
+    }
+
+
+    /// Return a random normalised vector which is orthogonal to `basis` and `block`.
+    DVector randomOrthogonalVector(std::size_t const dim, Block const &basis, Block const &block,
+                                   std::mt19937 &rng)
+    {
+        std::normal_distribution<double> distribution;
+        DVector v(dim);
+        for (std::size_t i = 0; i < dim; ++i) {
+            v[i] = distribution(rng);
+        }
+        orthogonalise(v, basis);
+        orthogonalise(v, block);
+        v /= norm(v);
+        return v;
+    }
+
+
+    /**
+     * Apply the operator to the last block of the Krylov basis and orthonormalise the result.
+     *
+     * \param apply The operator.
+     * \param basis Orthonormal Krylov basis, the last block starts at `first`.
+     * \param first Index of the first vector of the last block.
+     * \param projected Receives the projections `basis[i]^T A basis[j]` of the last block.
+     * \param coupling Set to `R` with `A basis[first:] = Q R + (components in basis)`.
+     * \param rng Random number generator for replacing linearly dependent vectors.
+     * \return The next block `Q` which is orthonormal and orthogonal to `basis`.
+     */
+    Block extend(LinearOperator const &apply, Block const &basis, std::size_t const first,
+                 DMatrix &projected, DMatrix &coupling, std::mt19937 &rng)
+    {
+        std::size_t const size = basis.size() - first;
+        std::size_t const dim = basis[0].size();
+
+        Block next(size);
+        std::vector<double> initialNorms(size);
+        for (std::size_t a = 0; a < size; ++a) {
+            apply(basis[first + a], next[a]);
+            initialNorms[a] = norm(next[a]);
+
+            auto const overlaps = orthogonalise(next[a], basis);
+            for (std::size_t i = 0; i < basis.size(); ++i) {
+                projected(i, first + a) = overlaps[i];
+                projected(first + a, i) = overlaps[i];
+            }
+        }
+
+        // QR decomposition of the new block
+        coupling.resize(size, size, false);
+        reset(coupling);
+        for (std::size_t a = 0; a < size; ++a) {
+            for (int pass = 0; pass < 2; ++pass) {
+                for (std::size_t c = 0; c < a; ++c) {
+                    double const overlap = dot(next[c], next[a]);
+                    next[a] -= overlap * next[c];
+                    coupling(c, a) += overlap;
+                }
+            }
+
+            if (double const nrm = norm(next[a]); nrm > dependenceThreshold * initialNorms[a]) {
+                coupling(a, a) = nrm;
+                next[a] /= nrm;
+            }
+            else {
+                // The Krylov space has (partially) become invariant, continue in a fresh direction.
+                Block const previous(next.begin(), next.begin() + static_cast<std::ptrdiff_t>(a));
+                next[a] = randomOrthogonalVector(dim, basis, previous, rng);
+            }
+        }
+
+        return next;
+    }
+
+
+    /// Return the number of leading eigenvalues whose Boltzmann weight is above the cutoff.
+    std::size_t numAboveCutoff(DVector const &eigenvalues, std::size_t const count,
+                               LanczosSettings const &settings)
+    {
+        double const window = -std::log(settings.boltzmannCutoff) / settings.beta;
+        std::size_t n = 0;
+        while (n < count and n < settings.maxEigenpairs
+               and eigenvalues[n] - eigenvalues[0] <= window) {
+            ++n;
+        }
+        return n;
+    }
+
+
+    /// Construct the full matrix of an operator by applying it to unit vectors.
+    DMatrix assemble(LinearOperator const &apply, std::size_t const dim)
+    {
+        DMatrix matrix(dim, dim);
+        DVector unit(dim, 0.0);
+        DVector column;
+        for (std::size_t j = 0; j < dim; ++j) {
+            unit[j] = 1.0;
+            apply(unit, column);
+            for (std::size_t i = 0; i < dim; ++i) {
+                matrix(i, j) = column[i];
+            }
+            unit[j] = 0.0;
+        }
+        return matrix;
+    }
+
+
+    /// Compute the lowest eigenpairs of a full matrix.
+    EigenPairs denseLowest(DMatrix matrix, LanczosSettings const &settings)
+    {
+        std::size_t const dim = matrix.rows();
+        DVector evals(dim);
+        blaze::syev(matrix, evals, 'V', 'U');
+
+        EigenPairs res;
+        std::size_t const count = numAboveCutoff(evals, dim, settings);
+        for (std::size_t i = 0; i < count; ++i) {
+            res.values.push_back(evals[i]);
+            // `syev` stores the eigenvectors row-wise in `matrix`.
+            DVector vec(dim);
+            for (std::size_t j = 0; j < dim; ++j) {
+                vec[j] = matrix(i, j);
+            }
+            res.vectors.push_back(std::move(vec));
+        }
+        return res;
+    }
+
+
+    /// Compute the first `count` Ritz vectors given eigenvectors of the projected matrix.
+    Block ritzVectors(Block const &basis, DMatrix const &eigenvectors, std::size_t const count)
+    {
+        Block res(count);
+        for (std::size_t i = 0; i < count; ++i) {
+            res[i].resize(basis[0].size(), false);
+            reset(res[i]);
+            // `syev` stores the eigenvectors row-wise.
+            for (std::size_t j = 0; j < basis.size(); ++j) {
+                res[i] += eigenvectors(i, j) * basis[j];
+            }
+        }
+        return res;
+    }
+}
+
+
+/*
+ * The algorithm maintains an orthonormal basis V of a Krylov space and the
+ * projected matrix T = V^T A V.
+ * Only the last block of V is mapped out of the space by A, i.e.
+ *   A V = V T + Q R E^T
+ * where Q is the next block, R its coupling to the last block, and E selects the last block.
+ * So the residual of a Ritz pair (theta, V y) is ||R y_last||.
+ *
+ * When the space is full, it is shrunk to the lowest Ritz vectors plus Q.
+ * This keeps the structure above because the residuals of all Ritz vectors lie in span(Q).
+ * T is diagonal on the Ritz vectors and all other elements are computed when
+ * extending the space.
+ */
+namespace {
+    /**
+     * Implements both overloads of lanczosLowest.
+     * \param fullMatrix Returns the full matrix of the operator for dense diagonalisation.
+     */
+    template <typename FullMatrix>
+    EigenPairs lanczosLowestImpl(LinearOperator const &apply, std::size_t const dim,
+                                 LanczosSettings const &settings, unsigned const seed,
+                                 FullMatrix const &fullMatrix)
+    {
+        std::size_t const blockSize = std::clamp(settings.blockSize, std::size_t{1},
+                                                 std::max(dim, std::size_t{1}));
+        auto const krylovSize = [blockSize](std::size_t const numWanted) {
+            return 2*numWanted + 3*blockSize;
+        };
+
+        std::size_t numWanted = std::max(std::size_t{1},
+                                         std::min(2*blockSize, settings.maxEigenpairs));
+        if (dim <= settings.denseThreshold or krylovSize(numWanted) >= dim) {
+            return denseLowest(fullMatrix(), settings);
+        }
+
+        std::mt19937 rng{seed};
+        Block basis;
+        Block next;
+        for (std::size_t a = 0; a < blockSize; ++a) {
+            next.push_back(randomOrthogonalVector(dim, basis, next, rng));
+        }
+
+        DMatrix projected(krylovSize(numWanted), krylovSize(numWanted), 0.0);
+        DMatrix coupling;
+        for (std::size_t restart = 0; restart < settings.maxRestarts; ++restart) {
+            std::size_t const maxSize = projected.rows();
+
+            // extend the Krylov space until it is full
+            std::size_t first;
+            do {
+                first = basis.size();
+                std::move(next.begin(), next.end(), std::back_inserter(basis));
+                next = extend(apply, basis, first, projected, coupling, rng);
+            } while (basis.size() + blockSize <= maxSize);
+
+            // Rayleigh-Ritz
+            std::size_t const size = basis.size();
+            DMatrix eigenvectors = submatrix(projected, 0, 0, size, size);
+            DVector eigenvalues(size);
+            blaze::syev(eigenvectors, eigenvalues, 'V', 'U');
+
+            std::size_t numConverged = 0;
+            for (; numConverged < size; ++numConverged) {
+                double residual = 0.0;
+                for (std::size_t c = 0; c < blockSize; ++c) {
+                    double r = 0.0;
+                    for (std::size_t a = 0; a < blockSize; ++a) {
+                        r += coupling(c, a) * eigenvectors(numConverged, first + a);
+                    }
+                    residual += r*r;
+                }
+                if (std::sqrt(residual) > settings.tolerance
+                                          * std::max(1.0, std::abs(eigenvalues[numConverged]))) {
+                    break;
+                }
+            }
+
+            if (numConverged >= numWanted) {
+                std::size_t const numKeep = numAboveCutoff(eigenvalues, numConverged, settings);
+                if (numKeep < numConverged or numWanted >= settings.maxEigenpairs) {
+                    auto const keptEnd = eigenvalues.begin() + static_cast<std::ptrdiff_t>(numKeep);
+                    return EigenPairs{
+                        std::vector<double>(eigenvalues.begin(), keptEnd),
+                        ritzVectors(basis, eigenvectors, numKeep)
+                    };
+                }
+
+                // All converged eigenpairs are relevant, look for more.
+                numWanted = std::min(2*numWanted, settings.maxEigenpairs);
+                if (krylovSize(numWanted) >= dim) {
+                    return denseLowest(fullMatrix(), settings);
+                }
+            }
+
+            // thick restart with the lowest Ritz vectors
+            std::size_t const newSize = krylovSize(numWanted);
+            std::size_t const numRitz = std::min(numWanted + blockSize, newSize - 2*blockSize);
+            basis = ritzVectors(basis, eigenvectors, numRitz);
+            projected.resize(newSize, newSize, false);
+            reset(projected);
+            for (std::size_t i = 0; i < numRitz; ++i) {
+                projected(i, i) = eigenvalues[i];
+            }
+        }
+
+        throw std::runtime_error("Lanczos algorithm did not converge");
+    }
+}
+
+
+EigenPairs lanczosLowest(LinearOperator const &apply, std::size_t const dim,
+                         LanczosSettings const &settings, unsigned const seed)
+{
+    return lanczosLowestImpl(apply, dim, settings, seed,
+                             [&] { return assemble(apply, dim); });
+}
+
+
+EigenPairs lanczosLowest(DSparseMatrix const &matrix, LanczosSettings const &settings,
+                         unsigned const seed)
+{
+    return lanczosLowestImpl([&](DVector const &x, DVector &y) { y = matrix * x; },
+                             matrix.rows(), settings, seed,
+                             [&] { return DMatrix(matrix); });
+}
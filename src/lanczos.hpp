@@ -0,0 +1,87 @@
+#ifndef EXACT_HUBBARD_LANCZOS_HPP
+#define EXACT_HUBBARD_LANCZOS_HPP
+
+/** \file
+ * \brief Iterative eigensolver for the lowest eigenpairs of symmetric operators.
+ */
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+#include "config.hpp"
+#include "linalg.hpp"
+
+
+/// Parameters of the Lanczos eigensolver.
+struct LanczosSettings
+{
+    /**
+     * Compute all eigenpairs with Boltzmann weight
+     * \f$ \exp(-\beta (E - E_0)) \f$ above this cutoff where
+     * \f$ E_0 \f$ is the lowest eigenvalue of the operator.
+     *
+     * This does not bound the error of correlators because intermediate states
+     * contribute with weights \f$ \exp(-\tau E_\alpha - (\beta-\tau) E_\gamma) \f$.
+     * Missing states change correlators by up to about
+     * \f$ \mathrm{cutoff}^{\min(\tau, \beta-\tau)/\beta} \f$,
+     * i.e. by \f$ \sqrt{\mathrm{cutoff}} \f$ at \f$ \tau = \beta/2 \f$
+     * but by several percent at \f$ \tau = 0 \f$ and \f$ \beta \f$.
+     * See sumRuleViolation for a measure of the latter.
+     */
+    double boltzmannCutoff = lanczosBoltzmannCutoff;
+    /// Inverse temperature for the Boltzmann weights.
+    double beta = ::beta;
+    /// Never compute more than this many eigenpairs.
+    std::size_t maxEigenpairs = 1000;
+    /// Number of vectors in each Lanczos block, must be at least the largest degeneracy.
+    std::size_t blockSize = 4;
+    /// Relative tolerance for residuals of eigenpairs.
+    double tolerance = 1e-10;
+    /// Maximum number of restarts.
+    std::size_t maxRestarts = 1000;
+    /// Operators with a dimension up to this are diagonalised densely.
+    std::size_t denseThreshold = 1000;
+};
+
+
+/// Eigenvalues in ascending order and corresponding eigenvectors.
+struct EigenPairs
+{
+    std::vector<double> values;
+    std::vector<DVector> vectors;
+};
+
+
+/// Function that computes `y = A x`.
+using LinearOperator = std::function<void(DVector const &x, DVector &y)>;
+
+
+/**
+ * Compute the lowest eigenpairs of a symmetric operator using
+ * block Lanczos with thick restarts and full reorthogonalisation.
+ *
+ * Starts by computing a few eigenpairs and increases their number until
+ * the Boltzmann weight of the highest one drops below `settings.boltzmannCutoff`.
+ * Only eigenpairs with a weight above the cutoff are returned.
+ *
+ * \param apply Computes `y = A x` for the operator `A`.
+ * \param dim Dimension of the vector space.
+ * \param settings Parameters of the algorithm.
+ * \param seed Seed for random starting vectors.
+ * \throws std::runtime_error if the algorithm does not converge.
+ */
+EigenPairs lanczosLowest(LinearOperator const &apply, std::size_t dim,
+                         LanczosSettings const &settings, unsigned seed = 0);
+
+
+/**
+ * Compute the lowest eigenpairs of a symmetric sparse matrix.
+ *
+ * Like the overload above but small matrices are converted to dense ones directly
+ * instead of being assembled from products with unit vectors.
+ */
+EigenPairs lanczosLowest(DSparseMatrix const &matrix, LanczosSettings const &settings,
+                         unsigned seed = 0);
+
+#endif //EXACT_HUBBARD_LANCZOS_HPP
@@ -0,0 +1,228 @@
+#include "lattice.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+
+namespace {
+    /// Return the weight of the link between two sites or 0 if there is none.
+    double linkWeight(std::vector<Link> const &links, std::vector<double> const &hoppings,
+                      std::size_t const a, std::size_t const b) noexcept
+    {
+        for (std::size_t l = 0; l < links.size(); ++l) {
+            if ((links[l].first == a and links[l].second == b)
+                or (links[l].first == b and links[l].second == a)) {
+                return hoppings[l];
+            }
+        }
+        return 0.0;
+    }
+
+
+    bool isPermutation(SitePermutation const &perm) noexcept
+    {
+        std::vector<bool> seen(perm.size(), false);
+        for (auto const x : perm) {
+            if (x >= perm.size() or seen[x]) {
+                return false;
+            }
+            seen[x] = true;
+        }
+        return true;
+    }
+}
+
+
+Lattice::Lattice(std::size_t const numSites, std::vector<Link> links,
+                 std::vector<double> hoppings,
+                 std::vector<SitePermutation> symmetryGenerators)
+        : numSites_{numSites}, links_{std::move(links)},
+          hoppings_{hoppings.empty() ? std::vector<double>(links_.size(), 1.0)
+                                     : std::move(hoppings)},
+          symmetryGenerators_{std::move(symmetryGenerators)}
+{
+    if (numSites_ == 0) {
+        throw std::invalid_argument("There must be more than 0 sites.");
+    }
+    if (numSites_ > maxNumSites) {
+        throw std::invalid_argument("The lattice has " + std::to_string(numSites_)
+                                    + " sites but at most maxNumSites="
+                                    + std::to_string(maxNumSites) + " are supported.");
+    }
+    if (hoppings_.size() != links_.size()) {
+        throw std::invalid_argument("There must be one hopping weight per link.");
+    }
+
+    std::vector<bool> linked(numSites_, false);
+    std::set<Link> uniqueLinks;
+    for (auto const &[a, b] : links_) {
+        if (a >= numSites_ or b >= numSites_) {
+            throw std::invalid_argument("All sites in links must be between 0 and numSites");
+        }
+        // Hopping terms need two different sites.
+        if (a == b) {
+            throw std::invalid_argument("Site " + std::to_string(a) + " is linked to itself.");
+        }
+        if (not uniqueLinks.emplace(std::min(a, b), std::max(a, b)).second) {
+            throw std::invalid_argument("Sites " + std::to_string(a) + " and "
+                                        + std::to_string(b) + " are linked more than once.");
+        }
+        linked[a] = true;
+        linked[b] = true;
+    }
+    if (std::find(linked.begin(), linked.end(), false) != linked.end()) {
+        throw std::invalid_argument("Links must contain every site on the lattice.");
+    }
+
+    for (auto const &generator : symmetryGenerators_) {
+        if (generator.size() != numSites_ or not isPermutation(generator)) {
+            throw std::invalid_argument(
+                    "Lattice symmetry generators must be permutations of sites.");
+        }
+        for (std::size_t l = 0; l < links_.size(); ++l) {
+            auto const [a, b] = links_[l];
+            if (linkWeight(links_, hoppings_, generator[a], generator[b]) != hoppings_[l]) {
+                throw std::invalid_argument("Lattice symmetry generators must map links "
+                                            "onto links with the same weight.");
+            }
+        }
+    }
+}
+
+
+Lattice Lattice::fromConfig()
+{
+    std::vector<SitePermutation> generators;
+    for (auto const &generator : latticeSymmetryGenerators) {
+        generators.emplace_back(generator.begin(), generator.end());
+    }
+    return Lattice{NSITES, {nearestNeighbours.begin(), nearestNeighbours.end()},
+                   {}, std::move(generators)};
+}
+
+
+Lattice Lattice::fromFile(std::filesystem::path const &fname)
+{
+    std::ifstream ifs{fname};
+    if (not ifs) {
+        throw std::runtime_error("Cannot read lattice file " + fname.string());
+    }
+
+    std::vector<Link> links;
+    std::vector<double> hoppings;
+    std::vector<SitePermutation> generators;
+    std::size_t numSites = 0;
+
+    std::string line;
+    for (std::size_t lineNumber = 1; std::getline(ifs, line); ++lineNumber) {
+        std::istringstream iss{line};
+        std::string first;
+        if (not (iss >> first) or first[0] == '#') {
+            continue;
+        }
+
+        auto const error = [&] {
+            return std::invalid_argument("Malformed line " + std::to_string(lineNumber)
+                                         + " in lattice file " + fname.string() + ": " + line);
+        };
+        // Indices are read as signed numbers, negative ones would wrap around otherwise.
+        auto const siteIndex = [&](long long const index) {
+            if (index < 0 or index >= static_cast<long long>(maxNumSites)) {
+                throw std::invalid_argument(
+                        "Site index " + std::to_string(index) + " on line "
+                        + std::to_string(lineNumber) + " in lattice file " + fname.string()
+                        + " must be at least 0 and less than maxNumSites="
+                        + std::to_string(maxNumSites));
+            }
+            return static_cast<std::size_t>(index);
+        };
+
+        if (first == "symmetry") {
+            SitePermutation generator;
+            for (long long x; iss >> x;) {
+                generator.push_back(siteIndex(x));
+            }
+            if (not iss.eof()) {
+                throw error();
+            }
+            generators.push_back(std::move(generator));
+            continue;
+        }
+
+        std::istringstream firstSite{first};
+        long long indexA;
+        long long indexB;
+        if (not (firstSite >> indexA) or not firstSite.eof() or not (iss >> indexB)) {
+            throw error();
+        }
+        std::size_t const a = siteIndex(indexA);
+        std::size_t const b = siteIndex(indexB);
+        double hopping = 1.0;
+        if (double weight; iss >> weight) {
+            hopping = weight;
+        }
+        else if (not iss.eof()) {
+            throw error();
+        }
+        iss.clear();
+        if (std::string rest; iss >> rest) {
+            throw error();
+        }
+
+        links.emplace_back(a, b);
+        hoppings.push_back(hopping);
+        numSites = std::max(numSites, std::max(a, b) + 1);
+    }
+
+    return Lattice{numSites, std::move(links), std::move(hoppings), std::move(generators)};
+}
+
+
+std::size_t Lattice::numSites() const noexcept
+{
+    return numSites_;
+}
+
+
+std::vector<Link> const &Lattice::links() const noexcept
+{
+    return links_;
+}
+
+
+std::vector<double> const &Lattice::hoppings() const noexcept
+{
+    return hoppings_;
+}
+
+
+std::vector<SitePermutation> const &Lattice::symmetryGenerators() const noexcept
+{
+    return symmetryGenerators_;
+}
+
+
+namespace {
+    Lattice &globalLattice()
+    {
+        static Lattice instance = Lattice::fromConfig();
+        return instance;
+    }
+}
+
+
+Lattice const &lattice()
+{
+    return globalLattice();
+}
+
+
+void setLattice(Lattice newLattice)
+{
+    globalLattice() = std::move(newLattice);
+}
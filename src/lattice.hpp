@@ -0,0 +1,99 @@
+#ifndef EXACT_HUBBARD_LATTICE_HPP
+#define EXACT_HUBBARD_LATTICE_HPP
+
+/** \file
+ * \brief Lattice geometry.
+ */
+
+#include <filesystem>
+#include <vector>
+
+#include "config.hpp"
+
+
+/// Permutation of lattice sites, site `x` is mapped to site `perm[x]`.
+using SitePermutation = std::vector<std::size_t>;
+
+
+/**
+ * Geometry of the lattice in terms of nearest-neighbour links.
+ *
+ * Each link has a hopping weight which multiplies kappa in the hopping terms
+ * of the Hamiltonian.
+ * The lattice is symmetric, a link {i, j} implies the link {j, i} with the same weight.
+ */
+class Lattice
+{
+public:
+    /**
+     * Construct from links.
+     * \param numSites Number of lattice sites, at most maxNumSites.
+     * \param links Nearest-neighbour links, must contain every site.
+     * \param hoppings Weight of each link, all weights are 1 if empty.
+     * \param symmetryGenerators Generators of the lattice symmetry group,
+     *                           use all automorphisms if empty.
+     * \throws std::invalid_argument if the parameters are inconsistent,
+     *         a site is linked to itself, or two sites are linked more than once.
+     */
+    Lattice(std::size_t numSites, std::vector<Link> links,
+            std::vector<double> hoppings = {},
+            std::vector<SitePermutation> symmetryGenerators = {});
+
+
+    /// Construct the lattice specified by nearestNeighbours and latticeSymmetryGenerators.
+    static Lattice fromConfig();
+
+
+    /**
+     * Read a lattice from a text file.
+     *
+     * Each line holds a link `i j` or a link with weight `i j weight`.
+     * Lines of the form `symmetry p_0 p_1 ... p_{N-1}` specify generators of the symmetry group
+     * as permutations of sites, site `x` is mapped to `p_x`.
+     * Empty lines and lines starting with `#` are ignored.
+     * The number of sites is the largest site index plus one.
+     * Every pair of sites may only be linked once, in either order,
+     * weights of repeated links are not summed.
+     * \throws std::runtime_error if the file cannot be read.
+     * \throws std::invalid_argument if the file is malformed.
+     */
+    static Lattice fromFile(std::filesystem::path const &fname);
+
+
+    /// Return the number of lattice sites.
+    [[nodiscard]] std::size_t numSites() const noexcept;
+
+    /// Return all nearest-neighbour links.
+    [[nodiscard]] std::vector<Link> const &links() const noexcept;
+
+    /// Return the hopping weight of each link.
+    [[nodiscard]] std::vector<double> const &hoppings() const noexcept;
+
+    /// Return the generators of the symmetry group, empty if all automorphisms should be used.
+    [[nodiscard]] std::vector<SitePermutation> const &symmetryGenerators() const noexcept;
+
+
+private:
+    std::size_t numSites_;
+    std::vector<Link> links_;
+    std::vector<double> hoppings_;
+    std::vector<SitePermutation> symmetryGenerators_;
+};
+
+
+/**
+ * Return the lattice that states and operators refer to.
+ *
+ * Is the lattice from config.hpp unless it was replaced by setLattice.
+ */
+Lattice const &lattice();
+
+
+/**
+ * Replace the lattice that states and operators refer to.
+ * \attention Must be called before any states or operators are used
+ *            and not concurrently with any other function.
+ */
+void setLattice(Lattice newLattice);
+
+#endif //EXACT_HUBBARD_LATTICE_HPP
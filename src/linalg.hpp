@@ -7,6 +7,9 @@
  * and define convenience aliases.
  */
 
+#include <cassert>
+#include <vector>
+
 #include <blaze/math/CompressedMatrix.h>
 #include <blaze/math/DynamicMatrix.h>
 #include <blaze/math/DynamicVector.h>
@@ -18,4 +21,34 @@ using DSparseMatrix = blaze::CompressedMatrix<double>;
 using DVector = blaze::DynamicVector<double>;
 using IVector = blaze::DynamicVector<int>;
 
+
+/**
+ * Construct a sparse matrix from compressed row storage.
+ * \param rows Number of rows.
+ * \param columns Number of columns.
+ * \param rowOffsets Elements of row `i` are stored in `[rowOffsets[i], rowOffsets[i+1])`.
+ *                   Must have length `rows+1`.
+ * \param columnIndices Column index of each element, ordered within each row.
+ * \param values Value of each element.
+ */
+inline DSparseMatrix fromCompressedRows(std::size_t const rows, std::size_t const columns,
+                                        std::vector<std::size_t> const &rowOffsets,
+                                        std::vector<std::size_t> const &columnIndices,
+                                        std::vector<double> const &values)
+{
+    assert(rowOffsets.size() == rows + 1);
+    assert(columnIndices.size() == rowOffsets.back());
+    assert(values.size() == rowOffsets.back());
+
+    DSparseMatrix mat(rows, columns);
+    mat.reserve(rowOffsets.back());
+    for (std::size_t i = 0; i < rows; ++i) {
+        for (std::size_t k = rowOffsets[i]; k < rowOffsets[i + 1]; ++k) {
+            mat.append(i, columnIndices[k], values[k]);
+        }
+        mat.finalize(i);
+    }
+    return mat;
+}
+
 #endif //EXACT_HUBBARD_LINALG_HPP
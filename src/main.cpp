@@ -1,33 +1,327 @@
+#include <algorithm>
+#include <charconv>
 #include <iostream>
 #include <chrono>
+#include <cstdint>
+#include <initializer_list>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
 
+#include "checkpoint.hpp"
+#include "cli.hpp"
 #include "correlators.hpp"
+#include "hash.hpp"
 #include "io.hpp"
+#include "lattice.hpp"
 #include "spectrum.hpp"
+#include "spectrum_cache.hpp"
+#include "state.hpp"
+#include "symmetry.hpp"
 
 
-int main()
+namespace {
+    /// Return "../<base><extension>" with all non-empty suffixes appended to base,
+    /// separated by underscores.
+    std::string outputFile(std::string const &base,
+                           std::initializer_list<std::string> const suffixes,
+                           std::string const &extension = ".dat")
+    {
+        std::string fname = "../" + base;
+        for (auto const &suffix : suffixes) {
+            if (not suffix.empty()) {
+                fname += "_" + suffix;
+            }
+        }
+        return fname + extension;
+    }
+
+
+    /// Format a parameter with the fewest digits that still identify its value exactly.
+    std::string formatParameter(double const value)
+    {
+        char buffer[32];
+        auto const result = std::to_chars(buffer, buffer + sizeof buffer, value);
+        return std::string(buffer, result.ptr);
+    }
+
+
+    /// Save a spectrum in the format requested on the command line.
+    void writeSpectrum(Spectrum const &spectrum, CommandLine const &cli,
+                       std::string const &parameterSuffix)
+    {
+        if (cli.binary) {
+            saveSpectrumBinary(outputFile("spectrum", {parameterSuffix}, ".bin"), spectrum,
+                               cli.eigenvectors);
+        }
+        else {
+            saveSpectrum(outputFile("spectrum", {parameterSuffix}), spectrum);
+        }
+    }
+
+
+    /// Return a key that identifies correlators computed from a given spectrum.
+    std::string correlatorsKey(std::string const &spectrumKey,
+                               std::vector<TimeLattice> const &timeLattices)
+    {
+        Hasher hasher;
+        hasher.add(spectrumKey);
+        for (auto const &timeLattice : timeLattices) {
+            hasher.add(timeLattice.beta);
+            hasher.add(std::uint64_t{timeLattice.nt});
+        }
+        return hasher.hexDigest();
+    }
+
+
+    /// Correlators that violate the sum rule by more than this are reported as inaccurate.
+    constexpr double sumRuleTolerance = 1e-6;
+
+
+    /// Print a warning if correlators at `beta` violate the sum rule by more than the tolerance.
+    void checkSumRule(double const violation, double const beta)
+    {
+        if (violation > sumRuleTolerance) {
+            std::cerr << "Warning: correlators at beta = " << beta
+                      << " violate the sum rule C_ii(0) + C_ii(beta) = 1 by up to " << violation
+                      << ".\n         The spectrum is truncated too much, lower "
+                         "lanczosBoltzmannCutoff or increase --max-charge.\n";
+        }
+    }
+
+
+    /**
+     * Compute and save correlators or their poles as requested on the command line.
+     * Correlators are checkpointed in `checkpoint` if it is not null, poles are not.
+     */
+    void computeObservables(Spectrum const &spectrum, CommandLine const &cli,
+                            std::string const &parameterSuffix,
+                            Checkpoint const *const checkpoint = nullptr)
+    {
+        if (cli.poles) {
+            // poles do not depend on NT
+            std::vector<double> betas;
+            for (auto const &timeLattice : cli.timeLattices) {
+                if (std::find(betas.begin(), betas.end(), timeLattice.beta) == betas.end()) {
+                    betas.push_back(timeLattice.beta);
+                }
+            }
+
+            for (auto const &poles : computeCorrelatorPoles(spectrum, betas)) {
+                checkSumRule(sumRuleViolation(poles), poles.beta);
+                std::ostringstream suffix;
+                if (betas.size() > 1) {
+                    suffix << "beta" << poles.beta;
+                }
+                savePoles(outputFile("poles", {parameterSuffix, suffix.str()}), poles);
+            }
+        }
+        else {
+            for (auto const &corrs : computeCorrelators(spectrum, cli.timeLattices, checkpoint)) {
+                checkSumRule(sumRuleViolation(corrs), corrs.timeLattice.beta);
+                std::ostringstream suffix;
+                if (cli.timeLattices.size() > 1) {
+                    suffix << "beta" << corrs.timeLattice.beta << "_nt" << corrs.timeLattice.nt;
+                }
+                if (cli.binary) {
+                    saveCorrelatorsBinary(
+                            outputFile("correlators", {parameterSuffix, suffix.str()}, ".bin"),
+                            corrs);
+                }
+                else {
+                    saveCorrelators(outputFile("correlators", {parameterSuffix, suffix.str()}),
+                                    corrs);
+                }
+            }
+        }
+    }
+
+
+    /// Print how often SumStates had to grow their storage, only available in debug builds.
+    void reportAllocations()
+    {
+#ifndef NDEBUG
+        std::cout << "SumState allocations: " << sumStateAllocations() << '\n';
+#endif
+    }
+}
+
+
+int main(int const argc, char *argv[])
 {
-    std::cout << "Nx = " << NSITES << ",  Nt = " << NT << '\n'
-              << "beta = " << beta << ",  U = " << U << ",  kappa = " << kappa << '\n';
+    CommandLine cli;
+    try {
+        cli = parseCommandLine(argc, argv);
+    }
+    catch (std::invalid_argument const &err) {
+        std::cerr << err.what() << '\n' << usage(argv[0]);
+        return 1;
+    }
+    if (cli.help) {
+        std::cout << usage(argv[0]);
+        return 0;
+    }
+
+    if (not cli.latticeFile.empty()) {
+        try {
+            setLattice(Lattice::fromFile(cli.latticeFile));
+        }
+        catch (std::exception const &err) {
+            std::cerr << err.what() << '\n';
+            return 1;
+        }
+    }
+
+    std::cout << "Nx = " << lattice().numSites() << '\n';
+    if (cli.maxCharge < lattice().numSites()) {
+        std::cout << "Only sectors with |charge| <= " << cli.maxCharge << '\n';
+    }
+    for (auto const &parameters : cli.parameters) {
+        std::cout << "U = " << parameters.U << ",  kappa = " << parameters.kappa << '\n';
+    }
+    for (auto const &timeLattice : cli.timeLattices) {
+        std::cout << "beta = " << timeLattice.beta << ",  Nt = " << timeLattice.nt << '\n';
+    }
+
+    // lattice symmetries
+    auto const symmetry = LatticeSymmetry::fromLattice(lattice());
+    std::cout << "Lattice symmetry group of order " << symmetry.order()
+              << " with " << symmetry.numClasses() << " conjugacy classes\n";
+
+    LanczosSettings lanczosSettings;
+    // The highest temperature needs the most states.
+    lanczosSettings.beta = std::min_element(
+            cli.timeLattices.begin(), cli.timeLattices.end(),
+            [](TimeLattice const &a, TimeLattice const &b) { return a.beta < b.beta; })->beta;
+    auto const solver = useLanczos ? Eigensolver::lanczos : Eigensolver::dense;
+
+    std::optional<SpectrumCache> cache;
+    if (not cli.cacheDirectory.empty()) {
+        cache.emplace(cli.cacheDirectory);
+    }
+
+    if (cli.parameters.size() > 1) {
+        // parameter sweep
+        std::mutex outputMutex;
+        auto const process = [&](Spectrum const &spectrum) {
+            // Distinct parameters must not write to the same files.
+            auto const formattedU = formatParameter(spectrum.parameters.U);
+            auto const formattedKappa = formatParameter(spectrum.parameters.kappa);
+            auto const suffix = "U" + formattedU + "_kappa" + formattedKappa;
+            writeSpectrum(spectrum, cli, suffix);
+            computeObservables(spectrum, cli, suffix);
+
+            std::lock_guard lock{outputMutex};
+            std::cout << "Finished U = " << formattedU << ",  kappa = " << formattedKappa
+                      << '\n';
+        };
+
+        std::vector<HubbardParameters> uncached;
+        for (auto const &parameters : cli.parameters) {
+            if (cache) {
+                if (auto const spectrum = cache->load(SpectrumCache::key(
+                            symmetry, parameters, solver, lanczosSettings, cli.maxCharge))) {
+                    process(*spectrum);
+                    continue;
+                }
+            }
+            uncached.push_back(parameters);
+        }
+        if (uncached.empty()) {
+            return 0;
+        }
+
+        auto startTime = std::chrono::high_resolution_clock::now();
+        SplitHamiltonian const hamiltonian{fockspaceBasis(cli.maxCharge), symmetry};
+        auto endTime = std::chrono::high_resolution_clock::now();
+        std::cout << "Time to assemble Hamiltonian: "
+                  << std::chrono::duration_cast<std::chrono::milliseconds>(
+                          endTime-startTime
+                  ).count() << "ms\n";
+
+        startTime = std::chrono::high_resolution_clock::now();
+        forEachSpectrum(hamiltonian, uncached, solver, lanczosSettings,
+                        [&](std::size_t, Spectrum const &spectrum) {
+            if (cache) {
+                cache->store(SpectrumCache::key(symmetry, spectrum.parameters, solver,
+                                                lanczosSettings, cli.maxCharge),
+                             spectrum);
+            }
+            process(spectrum);
+        });
+        endTime = std::chrono::high_resolution_clock::now();
+        std::cout << "Time to compute all parameters: "
+                  << std::chrono::duration_cast<std::chrono::milliseconds>(
+                          endTime-startTime
+                  ).count() << "ms\n";
+        reportAllocations();
+        return 0;
+    }
+
+    std::optional<Checkpoint> spectrumCheckpoint;
+    std::optional<Checkpoint> correlatorsCheckpoint;
+    if (not cli.checkpointDirectory.empty()) {
+        auto const spectrumKey = SpectrumCache::key(symmetry, cli.parameters.front(), solver,
+                                                    lanczosSettings, cli.maxCharge);
+        fs::path const directory{cli.checkpointDirectory};
+        try {
+            spectrumCheckpoint.emplace(directory / "spectrum", spectrumKey, cli.resume);
+            correlatorsCheckpoint.emplace(directory / "correlators",
+                                          correlatorsKey(spectrumKey, cli.timeLattices),
+                                          cli.resume);
+        }
+        catch (std::runtime_error const &err) {
+            std::cerr << err.what() << '\n';
+            return 1;
+        }
+    }
 
     // spectrum
     auto startTime = std::chrono::high_resolution_clock::now();
-    auto const spectrum = Spectrum::compute(fockspaceBasis());
+    auto const spectrum = [&] {
+        Checkpoint const *const checkpoint = spectrumCheckpoint ? &*spectrumCheckpoint : nullptr;
+        if (not cache) {
+            return Spectrum::compute(fockspaceBasis(cli.maxCharge), symmetry,
+                                     cli.parameters.front(), solver, lanczosSettings,
+                                     checkpoint);
+        }
+        auto const key = SpectrumCache::key(symmetry, cli.parameters.front(), solver,
+                                            lanczosSettings, cli.maxCharge);
+        if (auto loaded = cache->load(key)) {
+            std::cout << "Loaded spectrum from " << cache->file(key) << '\n';
+            return std::move(*loaded);
+        }
+        auto computed = Spectrum::compute(fockspaceBasis(cli.maxCharge), symmetry,
+                                          cli.parameters.front(), solver, lanczosSettings,
+                                          checkpoint);
+        cache->store(key, computed);
+        return computed;
+    }();
     auto endTime = std::chrono::high_resolution_clock::now();
     std::cout << "Time to compute spectrum: "
               << std::chrono::duration_cast<std::chrono::milliseconds>(
                       endTime-startTime
               ).count() << "ms\n";
-    saveSpectrum("../spectrum.dat", spectrum);
+    std::cout << "Sectors (particles, holes): size\n";
+    for (auto const &sector : spectrum.sectors) {
+        std::cout << "  (" << sector.numParticles << ", " << sector.numHoles << "): "
+                  << sector.size;
+        if (sector.numEigenstates < sector.size) {
+            std::cout << " (" << sector.numEigenstates << " eigenstates)";
+        }
+        std::cout << '\n';
+    }
+    writeSpectrum(spectrum, cli, "");
 
     // correlators
     startTime = std::chrono::high_resolution_clock::now();
-    auto const correlators = computeCorrelators(spectrum);
+    computeObservables(spectrum, cli, "",
+                       correlatorsCheckpoint ? &*correlatorsCheckpoint : nullptr);
     endTime = std::chrono::high_resolution_clock::now();
-    std::cout << "Time to compute correlators: "
+    std::cout << "Time to compute " << (cli.poles ? "poles" : "correlators") << ": "
               << std::chrono::duration_cast<std::chrono::milliseconds>(
                       endTime-startTime
               ).count() << "ms\n";
-    saveCorrelators("../correlators.dat", correlators);
+    reportAllocations();
 }
@@ -0,0 +1,130 @@
+#ifndef EXACT_HUBBARD_MATRIX_FREE_HPP
+#define EXACT_HUBBARD_MATRIX_FREE_HPP
+
+/** \file
+ * \brief Apply operators to vectors without storing matrices.
+ */
+
+#include <cassert>
+#include <utility>
+#include <vector>
+
+#include "basis_index.hpp"
+#include "linalg.hpp"
+#include "operator.hpp"
+#include "parallel.hpp"
+#include "state.hpp"
+
+
+/**
+ * Compute \f$ y = O x \f$ without constructing the matrix of \f$ O \f$.
+ *
+ * Matrix elements are generated on the fly by applying the operator to basis states
+ * and looking up the results in `index`.
+ * The memory requirement is O(dim).
+ *
+ * If the operator is hermitian (see isHermitian), the rows of `y` are computed in parallel
+ * by applying \f$ O \f$ to \f$ |i\rangle \f$ which gives
+ * \f$ y_i = \sum_j \langle i|O|j\rangle x_j = \sum_j \langle j|O|i\rangle x_j \f$.
+ * Otherwise, columns are processed in parallel and each thread accumulates
+ * into its own copy of `y`.
+ *
+ * \param op %Operator \f$ O \f$.
+ * \param basis Basis states, `x` and `y` hold coefficients of these states.
+ * \param index Index of `basis`.
+ * \param x Input vector.
+ * \param y Output vector, is resized and overwritten.
+ */
+template <typename T>
+void applyMatrixFree(Operator<T> const &op, SumState const &basis, BasisIndex const &index,
+                     DVector const &x, DVector &y)
+{
+    assert(x.size() == basis.size());
+    y.resize(basis.size(), false);
+
+    if constexpr (isHermitian_v<T>) {
+        parallelFor(basis.size(), [&](std::size_t const begin, std::size_t const end,
+                                      std::size_t) {
+            ScratchSumState out{op.maxOutputsPerState()};
+            for (std::size_t i = begin; i < end; ++i) {
+                out->clear();
+                auto const &[coefi, statei] = basis[i];
+                op.apply(statei, *out);
+
+                double yi = 0.0;
+                for (std::size_t k = 0; k < out->size(); ++k) {
+                    auto const &[coefk, statek] = std::as_const(*out)[k];
+                    if (std::size_t const j = index.find(statek); j != BasisIndex::npos) {
+                        yi += coefk * coefi * basis[j].first * x[j];
+                    }
+                }
+                y[i] = yi;
+            }
+        });
+    }
+    else {
+        std::vector<DVector> partial(numParallelChunks(basis.size()));
+        parallelFor(basis.size(), [&](std::size_t const begin, std::size_t const end,
+                                      std::size_t const chunk) {
+            DVector &yc = partial[chunk];
+            yc.resize(basis.size(), false);
+            reset(yc);
+
+            ScratchSumState out{op.maxOutputsPerState()};
+            for (std::size_t j = begin; j < end; ++j) {
+                out->clear();
+                auto const &[coefj, statej] = basis[j];
+                op.apply(statej, *out);
+
+                for (std::size_t k = 0; k < out->size(); ++k) {
+                    auto const &[coefk, statek] = std::as_const(*out)[k];
+                    if (std::size_t const i = index.find(statek); i != BasisIndex::npos) {
+                        yc[i] += coefk * basis[i].first * coefj * x[j];
+                    }
+                }
+            }
+        });
+
+        y = std::move(partial[0]);
+        for (std::size_t chunk = 1; chunk < partial.size(); ++chunk) {
+            y += partial[chunk];
+        }
+    }
+}
+
+
+/**
+ * An operator restricted to a basis that can be applied to vectors without
+ * storing its matrix.
+ *
+ * Holds references to the operator, basis, and index, they must outlive this object.
+ */
+template <typename T>
+class MatrixFreeOperator
+{
+    Operator<T> const &op_;
+    SumState const &basis_;
+    BasisIndex const &index_;
+
+public:
+    /// Store references to the operator and basis.
+    MatrixFreeOperator(Operator<T> const &op, SumState const &basis, BasisIndex const &index)
+            : op_{op}, basis_{basis}, index_{index}
+    { }
+
+
+    /// Return the dimension of the basis.
+    [[nodiscard]] std::size_t size() const noexcept
+    {
+        return basis_.size();
+    }
+
+
+    /// Compute y = O x.
+    void apply(DVector const &x, DVector &y) const
+    {
+        applyMatrixFree(op_, basis_, index_, x, y);
+    }
+};
+
+#endif //EXACT_HUBBARD_MATRIX_FREE_HPP
@@ -8,25 +8,33 @@
  * The derived class must implement
  *   `void apply_implSingleOutparam(State const &state, SumState &out)`
  * which takes a single state, applies the operator, and appends the output to `out`.
+ * It may implement
+ *   `std::size_t maxOutputsPerState_impl()`
+ * which returns an upper bound on the number of states appended by a single call to
+ * `apply_implSingleOutparam`. This is used to size output buffers up front.
+ * Operators that are hermitian should declare `constexpr static bool hermitian = true;`.
  */
 
+#include <algorithm>
 #include <cstdint>
+#include <iterator>
+#include <tuple>
+#include <type_traits>
 #include <utility>
+#include <vector>
 
 #include "always_false.hpp"
+#include "basis_index.hpp"
 #include "linalg.hpp"
+#include "parallel.hpp"
 #include "state.hpp"
 
 
 /// Count the number of particles *and* holes before and excluding the given site.
-constexpr int countPHBefore(State const &state, std::size_t const site) noexcept
+inline int countPHBefore(State const &state, std::size_t const site)
 {
     assert(site < state.size());
-    int count = 0;
-    for (std::size_t i = 0; i < site; ++i) {
-        count += state.numberOn(i);
-    }
-    return count;
+    return state.numberBefore(site);
 }
 
 
@@ -41,6 +49,29 @@ struct hasApplyImplSingleOutparam<T,
         : std::true_type {};
 
 
+/// Check whether a type has a member function `maxOutputsPerState_impl`.
+template <typename T, typename = void>
+struct hasMaxOutputsPerStateImpl : std::false_type {};
+
+template <typename T>
+struct hasMaxOutputsPerStateImpl<T,
+        std::void_t<decltype(std::declval<T>().maxOutputsPerState_impl())>>
+        : std::true_type {};
+
+
+/// Check whether an operator is marked as hermitian.
+template <typename T, typename = void>
+struct isHermitian : std::false_type {};
+
+template <typename T>
+struct isHermitian<T, std::void_t<decltype(T::hermitian)>>
+        : std::bool_constant<T::hermitian> {};
+
+/// Helper variable for isHermitian.
+template <typename T>
+constexpr static bool isHermitian_v = isHermitian<T>::value;
+
+
 /// Base template for operators.
 /**
  * Operators implementations should inherit from this class using CRTP.
@@ -66,6 +97,21 @@ struct Operator
     }
 
 
+    /**
+     * Return an upper bound on the number of states produced by applying the operator to
+     * a single state or 0 if the operator does not provide one.
+     */
+    [[nodiscard]] std::size_t maxOutputsPerState() const
+    {
+        if constexpr (hasMaxOutputsPerStateImpl<Derived>::value) {
+            return asDerived().maxOutputsPerState_impl();
+        }
+        else {
+            return 0;
+        }
+    }
+
+
     /// Apply the operator to a single state and append the result to `out`.
     void apply(State const &state, SumState &out) const
     {
@@ -103,9 +149,55 @@ struct Operator
         apply(states, out);
         return out;
     }
+
+
+    /**
+     * Apply the operator to all states in `in` and add the results to `out`.
+     *
+     * Terms with equal states are merged as they are produced,
+     * so `out` never holds duplicates.
+     */
+    void apply(SumState const &in, SumStateAccumulator &out) const
+    {
+        ScratchSumState scratch{maxOutputsPerState()};
+        for (std::size_t i = 0; i < in.size(); ++i) {
+            auto const &[coef, state] = in[i];
+            scratch->clear();
+            apply(state, *scratch);
+            out.add(*scratch, coef);
+        }
+    }
+
+
+    /**
+     * Apply the operator to all states in `states` and return a new, compressed SumState.
+     *
+     * Equivalent to `apply(states)` followed by SumState::compress but never stores
+     * duplicate states, see SumStateAccumulator.
+     * Use this to build states by applying strings of operators.
+     */
+    [[nodiscard]] SumState applyCompressed(SumState const &states) const
+    {
+        SumStateAccumulator out{states.size()};
+        apply(states, out);
+        return out.finish();
+    }
 };
 
 
+/**
+ * Compute the expectation value \f$ \langle\psi|O|\psi\rangle \f$ of an operator.
+ *
+ * Merges terms while applying the operator and computes the overlap by merging sorted states,
+ * so the cost is linear in the number of terms up to sorting.
+ */
+template <typename T>
+double expectationValue(Operator<T> const &op, SumState const &psi)
+{
+    return dot(psi, op.applyCompressed(psi));
+}
+
+
 /// The sum of multiple operators.
 /**
  * Use e.g. as
@@ -120,12 +212,15 @@ template <typename... Operators>
 struct SumOperator : Operator<SumOperator<Operators...>>
 {
     /// Stores all summands (sub operators).
-    std::tuple<Operator<Operators>...> operators;
+    std::tuple<Operators...> operators;
+
+    /// The sum is hermitian if all summands are.
+    constexpr static bool hermitian = (isHermitian_v<Operators> and ...);
 
 
     /// Construct from one or more summands.
     explicit constexpr SumOperator(Operator<Operators> const & ... ops)
-            : operators{ops...}
+            : operators{ops.asDerived()...}
     { }
 
 
@@ -138,6 +233,15 @@ struct SumOperator : Operator<SumOperator<Operators...>>
     }
 
 
+    /// Every summand contributes its own outputs.
+    [[nodiscard]] std::size_t maxOutputsPerState_impl() const
+    {
+        return std::apply([](auto const &... ops) {
+            return (std::size_t{0} + ... + ops.maxOutputsPerState());
+        }, operators);
+    }
+
+
 private:
     /// Recursively apply sub operators.
     template <std::size_t Idx>
@@ -179,6 +283,12 @@ struct ParticleCreator : Operator<ParticleCreator>
         out.push(countPHBefore(state, site) % 2 == 0 ? +1.0 : -1.0,
                  aux);
     }
+
+    /// Produces at most one state.
+    [[nodiscard]] constexpr std::size_t maxOutputsPerState_impl() const noexcept
+    {
+        return 1;
+    }
 };
 
 
@@ -204,6 +314,12 @@ struct ParticleAnnihilator : Operator<ParticleAnnihilator>
         out.push(countPHBefore(state, site) % 2 == 0 ? +1.0 : -1.0,
                  aux);
     }
+
+    /// Produces at most one state.
+    [[nodiscard]] constexpr std::size_t maxOutputsPerState_impl() const noexcept
+    {
+        return 1;
+    }
 };
 
 
@@ -230,6 +346,12 @@ struct HoleCreator : Operator<HoleCreator>
         out.push(nswaps % 2 == 0 ? +1.0 : -1.0,
                  aux);
     }
+
+    /// Produces at most one state.
+    [[nodiscard]] constexpr std::size_t maxOutputsPerState_impl() const noexcept
+    {
+        return 1;
+    }
 };
 
 
@@ -256,6 +378,12 @@ struct HoleAnnihilator : Operator<HoleAnnihilator>
         out.push(nswaps % 2 == 0 ? +1.0 : -1.0,
                  aux);
     }
+
+    /// Produces at most one state.
+    [[nodiscard]] constexpr std::size_t maxOutputsPerState_impl() const noexcept
+    {
+        return 1;
+    }
 };
 
 
@@ -267,15 +395,20 @@ struct HoleAnnihilator : Operator<HoleAnnihilator>
 template <bool USE_PREFACTOR=true>
 struct SquaredNumberOperator : Operator<SquaredNumberOperator<USE_PREFACTOR>>
 {
+    constexpr static bool hermitian = true;
+
+    /// On-site interaction strength, only used if `USE_PREFACTOR` is `true`.
+    double U;
+
+
+    /// Specify the interaction strength, defaults to U from config.hpp.
+    explicit constexpr SquaredNumberOperator(double const inU = ::U) noexcept : U{inU} { }
+
+
     /// Implementation of apply.
     void apply_implSingleOutparam(State const &state, SumState &out) const
     {
-        int number = 0;
-        for (std::size_t site = 0; site < NSITES; ++site) {
-            if ((state.hasParticleOn(site) ^ state.hasHoleOn(site)) != 0) {
-                number++;
-            }
-        }
+        int const number = state.numChargedSites();
         if (number != 0) {
             if constexpr (USE_PREFACTOR) {
                 out.push(U / 2.0 * static_cast<double>(number), state);
@@ -285,6 +418,13 @@ struct SquaredNumberOperator : Operator<SquaredNumberOperator<USE_PREFACTOR>>
             }
         }
     }
+
+
+    /// Produces at most one state.
+    [[nodiscard]] constexpr std::size_t maxOutputsPerState_impl() const noexcept
+    {
+        return 1;
+    }
 };
 
 
@@ -293,6 +433,9 @@ struct SquaredNumberOperator : Operator<SquaredNumberOperator<USE_PREFACTOR>>
  */
 struct ChargeOperator : Operator<ChargeOperator>
 {
+    constexpr static bool hermitian = true;
+
+
     /// Implementation of apply.
     void apply_implSingleOutparam(State const &state, SumState &out) const
     {
@@ -303,15 +446,17 @@ struct ChargeOperator : Operator<ChargeOperator>
     }
 
 
+    /// Produces at most one state.
+    [[nodiscard]] constexpr std::size_t maxOutputsPerState_impl() const noexcept
+    {
+        return 1;
+    }
+
+
     /// Compute the charge of a state.
     [[nodiscard]] int computeCharge(State const &state) const noexcept
     {
-        int number = 0;
-        for (std::size_t site = 0; site < NSITES; ++site) {
-            number += static_cast<int>(state.hasParticleOn(site))
-                      - static_cast<int>(state.hasHoleOn(site));
-        }
-        return number;
+        return state.numParticles() - state.numHoles();
     }
 };
 
@@ -319,37 +464,57 @@ struct ChargeOperator : Operator<ChargeOperator>
 /**
  * Hopping operator for particles.
  * Annihilates and creates particles according to the hopping matrix
- * as parameterised by nearestNeighbours and kappa.
+ * as parameterised by the links of lattice(), their weights w_xy,
+ * and the hopping parameter kappa.
  * The operator can be written as
  * \f[
-   -\kappa \sum_{\langle x, y\rangle}\, a_x^\dagger a_y
+   -\kappa \sum_{\langle x, y\rangle}\, w_{xy} a_x^\dagger a_y
  * \f]
  */
 struct ParticleHop : Operator<ParticleHop>
 {
     using Operator<ParticleHop>::apply;
 
+    constexpr static bool hermitian = true;
+
+    /// Hopping parameter.
+    double kappa;
+
+
+    /// Specify the hopping parameter, defaults to kappa from config.hpp.
+    explicit constexpr ParticleHop(double const inKappa = ::kappa) noexcept : kappa{inKappa} { }
+
 
     /// Implementation of apply.
     void apply_implSingleOutparam(State const &state, SumState &out) const
     {
-        for (auto const [a, b] : nearestNeighbours) {
+        auto const &links = lattice().links();
+        auto const &hoppings = lattice().hoppings();
+        for (std::size_t l = 0; l < links.size(); ++l) {
+            auto const [a, b] = links[l];
             if (state.hasParticleOn(a) and not state.hasParticleOn(b)) {
                 auto const [coef, newState] = doHop(state, a, b);
-                out.push(coef, newState);
+                out.push(hoppings[l] * coef, newState);
             }
             // Can use else here because we can never hop to *and* from a site.
             else if (state.hasParticleOn(b) and not state.hasParticleOn(a)) {
                 auto const [coef, newState] = doHop(state, b, a);
-                out.push(coef, newState);
+                out.push(hoppings[l] * coef, newState);
             }
         }
     }
 
 
+    /// Hops in at most one direction per link.
+    [[nodiscard]] std::size_t maxOutputsPerState_impl() const noexcept
+    {
+        return lattice().links().size();
+    }
+
+
 private:
     [[nodiscard]] std::pair<double, State>
-    doHop(State const &state, std::size_t const from, std::size_t const to) const noexcept
+    doHop(State const &state, std::size_t const from, std::size_t const to) const
     {
         // How often does the annihilator have to swap places with another operator?
         auto const nSwapAnnihilate = countPHBefore(state, from);
@@ -371,37 +536,57 @@ private:
 /**
  * Hopping operator for particles.
  * Annihilates and creates particles according to the hopping matrix
- * as parameterised by nearestNeighbours and kappa.
+ * as parameterised by the links of lattice(), their weights w_xy,
+ * and the hopping parameter kappa.
  * The operator can be written as
  * \f[
-   \kappa \sum_{\langle x, y\rangle}\, b_x^\dagger b_y
+   \kappa \sum_{\langle x, y\rangle}\, w_{xy} b_x^\dagger b_y
  * \f]
  */
 struct HoleHop : Operator<HoleHop>
 {
     using Operator<HoleHop>::apply;
 
+    constexpr static bool hermitian = true;
+
+    /// Hopping parameter.
+    double kappa;
+
+
+    /// Specify the hopping parameter, defaults to kappa from config.hpp.
+    explicit constexpr HoleHop(double const inKappa = ::kappa) noexcept : kappa{inKappa} { }
+
 
     /// Implementation of apply.
     void apply_implSingleOutparam(State const &state, SumState &out) const
     {
-        for (auto const [a, b] : nearestNeighbours) {
+        auto const &links = lattice().links();
+        auto const &hoppings = lattice().hoppings();
+        for (std::size_t l = 0; l < links.size(); ++l) {
+            auto const [a, b] = links[l];
             if (state.hasHoleOn(a) and not state.hasHoleOn(b)) {
                 auto const [coef, newState] = doHop(state, a, b);
-                out.push(coef, newState);
+                out.push(hoppings[l] * coef, newState);
             }
                 // Can use else here because we can never hop to *and* from a site.
             else if (state.hasHoleOn(b) and not state.hasHoleOn(a)) {
                 auto const [coef, newState] = doHop(state, b, a);
-                out.push(coef, newState);
+                out.push(hoppings[l] * coef, newState);
             }
         }
     }
 
 
+    /// Hops in at most one direction per link.
+    [[nodiscard]] std::size_t maxOutputsPerState_impl() const noexcept
+    {
+        return lattice().links().size();
+    }
+
+
 private:
     [[nodiscard]] std::pair<double, State>
-    doHop(State const &state, std::size_t const from, std::size_t const to) const noexcept
+    doHop(State const &state, std::size_t const from, std::size_t const to) const
     {
         // How often does the annihilator have to swap places with another operator?
         auto const nSwapAnnihilate = countPHBefore(state, from) + (state.hasParticleOn(from) ? 1 : 0);
@@ -425,36 +610,155 @@ private:
 
  * @param op %Operator \f$ O \f$.
  * @param basis Each state in `basis` is a basis state \f$ |i\rangle \f$
+ * @param index Index of `basis`.
  * @return \f$ M_{ij} = \langle i | O | j \rangle \f$
  */
 template <typename T>
-DMatrix toMatrix(Operator<T> const &op, SumState const &basis)
+DMatrix toMatrix(Operator<T> const &op, SumState const &basis, BasisIndex const &index)
 {
-    DMatrix mat{basis.size(), basis.size()};
-    SumState out;
+    DMatrix mat(basis.size(), basis.size(), 0.0);
+    ScratchSumState out{op.maxOutputsPerState()};
 
     for (std::size_t j = 0; j < mat.columns(); ++j)
     {
-        out.clear();
+        out->clear();
         // |j>
         auto const &[coefj, statej] = basis[j];
         // out = op |j>
-        op.apply(statej, out);
-
-        for (std::size_t i = 0; i < mat.rows(); ++i) {
-            // |i>
-            auto const &[coefi, statei] = basis[i];
-            // <i|op|j>
-            double matelem = 0.0;
-            for (std::size_t k = 0; k < out.size(); ++k) {
-                auto const &[coefk, statek] = out[k];
-                matelem += dot(statek, statei) * coefk * coefi * coefj;
+        op.apply(statej, *out);
+
+        for (std::size_t k = 0; k < out->size(); ++k) {
+            auto const &[coefk, statek] = std::as_const(*out)[k];
+            // <i| such that <i|statek> = 1, states outside of the basis do not contribute
+            if (std::size_t const i = index.find(statek); i != BasisIndex::npos) {
+                mat(i, j) += coefk * basis[i].first * coefj;
             }
-            mat(i, j) = matelem;
         }
     }
 
     return mat;
 }
 
+
+/**
+ * Compute all matrix elements of an operator.
+
+ * @param op %Operator \f$ O \f$.
+ * @param basis Each state in `basis` is a basis state \f$ |i\rangle \f$
+ * @return \f$ M_{ij} = \langle i | O | j \rangle \f$
+ */
+template <typename T>
+DMatrix toMatrix(Operator<T> const &op, SumState const &basis)
+{
+    return toMatrix(op, basis, BasisIndex{basis});
+}
+
+
+/**
+ * Compute all matrix elements of an operator and store them in a sparse matrix.
+ *
+ * Columns are computed in parallel, each thread handles a contiguous range of columns.
+ * The results are then merged into compressed row storage, so the memory
+ * requirement scales with the number of non-zero elements.
+
+ * @param op %Operator \f$ O \f$.
+ * @param basis Each state in `basis` is a basis state \f$ |i\rangle \f$
+ * @param index Index of `basis`.
+ * @return \f$ M_{ij} = \langle i | O | j \rangle \f$
+ */
+template <typename T>
+DSparseMatrix toSparseMatrix(Operator<T> const &op, SumState const &basis,
+                             BasisIndex const &index)
+{
+    struct Element
+    {
+        std::size_t row;
+        std::size_t column;
+        double value;
+    };
+
+    // Elements of each chunk of columns, ordered by column and row.
+    std::vector<std::vector<Element>> chunkElements(numParallelChunks(basis.size()));
+    parallelFor(basis.size(), [&](std::size_t const begin, std::size_t const end,
+                                  std::size_t const chunk) {
+        auto &elements = chunkElements[chunk];
+        ScratchSumState out{op.maxOutputsPerState()};
+        for (std::size_t j = begin; j < end; ++j) {
+            out->clear();
+            // out = op |j>
+            auto const &[coefj, statej] = basis[j];
+            op.apply(statej, *out);
+
+            auto const columnBegin = elements.size();
+            for (std::size_t k = 0; k < out->size(); ++k) {
+                auto const &[coefk, statek] = std::as_const(*out)[k];
+                if (std::size_t const i = index.find(statek); i != BasisIndex::npos) {
+                    elements.push_back({i, j, coefk * basis[i].first * coefj});
+                }
+            }
+
+            // sort column and merge elements with the same row
+            auto const first = elements.begin()
+                               + static_cast<std::ptrdiff_t>(columnBegin);
+            std::sort(first, elements.end(),
+                      [](Element const &a, Element const &b) { return a.row < b.row; });
+            auto merged = first;
+            for (auto it = first; it != elements.end(); ++it) {
+                if (merged != first and std::prev(merged)->row == it->row) {
+                    std::prev(merged)->value += it->value;
+                }
+                else {
+                    *merged++ = *it;
+                }
+            }
+            elements.erase(std::remove_if(first, merged,
+                                          [](Element const &e) { return e.value == 0.0; }),
+                           elements.end());
+        }
+    });
+
+    // Counting sort elements into rows.
+    // Chunks and elements within chunks are ordered by column,
+    // so every row ends up being ordered by column as well.
+    std::vector<std::size_t> rowOffsets(basis.size() + 1, 0);
+    for (auto const &elements : chunkElements) {
+        for (auto const &element : elements) {
+            rowOffsets[element.row + 1]++;
+        }
+    }
+    for (std::size_t i = 0; i < basis.size(); ++i) {
+        rowOffsets[i + 1] += rowOffsets[i];
+    }
+
+    std::vector<std::size_t> columns(rowOffsets.back());
+    std::vector<double> values(rowOffsets.back());
+    {
+        std::vector<std::size_t> insertionPoints(rowOffsets.begin(), rowOffsets.end() - 1);
+        for (auto &elements : chunkElements) {
+            for (auto const &element : elements) {
+                auto const pos = insertionPoints[element.row]++;
+                columns[pos] = element.column;
+                values[pos] = element.value;
+            }
+            elements = {};  // release memory early
+        }
+    }
+
+    return fromCompressedRows(basis.size(), basis.size(), rowOffsets, columns, values);
+}
+
+
+/**
+ * Compute all matrix elements of an operator and store them in a sparse matrix.
+
+ * @param op %Operator \f$ O \f$.
+ * @param basis Each state in `basis` is a basis state \f$ |i\rangle \f$
+ * @return \f$ M_{ij} = \langle i | O | j \rangle \f$
+ */
+template <typename T>
+DSparseMatrix toSparseMatrix(Operator<T> const &op, SumState const &basis)
+{
+    return toSparseMatrix(op, basis, BasisIndex{basis});
+}
+
 #endif //EXACT_HUBBARD_OPERATOR_HPP
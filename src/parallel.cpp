@@ -0,0 +1,152 @@
+#include "parallel.hpp"
+
+#include <cstdlib>
+#include <string>
+#include <utility>
+
+
+#if defined __GNUG__
+// Resolve to nullptr if the respective library is not linked.
+extern "C" {
+    void openblas_set_num_threads(int) __attribute__((weak));
+    void MKL_Set_Num_Threads(int) __attribute__((weak));
+}
+#endif
+
+
+namespace {
+    thread_local bool parallelRegion = false;
+}
+
+
+std::size_t numThreads()
+{
+    static std::size_t const nthreads = [] {
+        if (char const *env = std::getenv("EXACT_HUBBARD_NUM_THREADS"); env != nullptr) {
+            if (auto const n = std::stoul(env); n > 0) {
+                return std::size_t{n};
+            }
+        }
+        return std::max(std::size_t{1},
+                        static_cast<std::size_t>(std::thread::hardware_concurrency()));
+    }();
+    return nthreads;
+}
+
+
+bool inParallelRegion() noexcept
+{
+    return parallelRegion;
+}
+
+
+ParallelRegionGuard::ParallelRegionGuard() noexcept
+        : previous_{std::exchange(parallelRegion, true)}
+{ }
+
+
+ParallelRegionGuard::~ParallelRegionGuard()
+{
+    parallelRegion = previous_;
+}
+
+
+bool setBlasThreads([[maybe_unused]] std::size_t const n)
+{
+#if BLAS_IS_PARALLEL && defined __GNUG__
+    if (openblas_set_num_threads != nullptr) {
+        openblas_set_num_threads(static_cast<int>(n));
+        return true;
+    }
+    if (MKL_Set_Num_Threads != nullptr) {
+        MKL_Set_Num_Threads(static_cast<int>(n));
+        return true;
+    }
+#endif
+    return false;
+}
+
+
+ThreadPool::ThreadPool(std::size_t const nthreads)
+{
+    workers_.reserve(nthreads);
+    for (std::size_t i = 0; i < nthreads; ++i) {
+        workers_.emplace_back(&ThreadPool::work, this);
+    }
+}
+
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::unique_lock lock{mutex_};
+        tasksDone_.wait(lock, [this] { return tasks_.empty() and numRunning_ == 0; });
+        stop_ = true;
+    }
+    taskAvailable_.notify_all();
+    for (auto &worker : workers_) {
+        worker.join();
+    }
+}
+
+
+void ThreadPool::submit(std::function<void()> task)
+{
+    {
+        std::lock_guard lock{mutex_};
+        tasks_.push_back(std::move(task));
+    }
+    taskAvailable_.notify_one();
+}
+
+
+void ThreadPool::wait()
+{
+    std::unique_lock lock{mutex_};
+    tasksDone_.wait(lock, [this] { return tasks_.empty() and numRunning_ == 0; });
+    if (exception_) {
+        std::rethrow_exception(std::exchange(exception_, nullptr));
+    }
+}
+
+
+std::size_t ThreadPool::size() const noexcept
+{
+    return workers_.size();
+}
+
+
+void ThreadPool::work()
+{
+    ParallelRegionGuard const guard;
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock lock{mutex_};
+            taskAvailable_.wait(lock, [this] { return stop_ or not tasks_.empty(); });
+            if (tasks_.empty()) {
+                return;  // stop_ is set
+            }
+            task = std::move(tasks_.front());
+            tasks_.pop_front();
+            numRunning_++;
+        }
+
+        std::exception_ptr exception;
+        try {
+            task();
+        }
+        catch (...) {
+            exception = std::current_exception();
+        }
+
+        {
+            std::lock_guard lock{mutex_};
+            if (exception and not exception_) {
+                exception_ = exception;
+            }
+            numRunning_--;
+        }
+        tasksDone_.notify_all();
+    }
+}
@@ -0,0 +1,165 @@
+#ifndef EXACT_HUBBARD_PARALLEL_HPP
+#define EXACT_HUBBARD_PARALLEL_HPP
+
+/** \file
+ * \brief Simple shared memory parallelism.
+ */
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+/**
+ * Return the number of threads to use for parallel loops.
+ *
+ * Reads environment variable `EXACT_HUBBARD_NUM_THREADS` if it is set
+ * and uses the number of hardware threads otherwise.
+ */
+std::size_t numThreads();
+
+
+/**
+ * Return `true` if the calling thread is executing a task of parallelFor or ThreadPool.
+ *
+ * Parallel loops nested inside such tasks run serially to avoid oversubscription.
+ */
+bool inParallelRegion() noexcept;
+
+
+/// Mark the calling thread as executing a parallel task for the lifetime of this object.
+class ParallelRegionGuard
+{
+public:
+    ParallelRegionGuard() noexcept;
+    ~ParallelRegionGuard();
+
+    ParallelRegionGuard(ParallelRegionGuard const &) = delete;
+    ParallelRegionGuard &operator=(ParallelRegionGuard const &) = delete;
+    ParallelRegionGuard(ParallelRegionGuard &&) = delete;
+    ParallelRegionGuard &operator=(ParallelRegionGuard &&) = delete;
+
+private:
+    bool previous_;
+};
+
+
+/// Return the number of chunks parallelFor splits a range of size `n` into.
+inline std::size_t numParallelChunks(std::size_t const n)
+{
+    if (inParallelRegion()) {
+        return 1;
+    }
+    return std::max(std::size_t{1}, std::min(n, numThreads()));
+}
+
+
+/**
+ * Split the range `[0, n)` into contiguous chunks and process them in parallel.
+ *
+ * Calls `f(begin, end, chunk)` for each chunk where `chunk` is in `[0, numParallelChunks(n))`.
+ * Chunks are ordered, i.e. chunk `c` covers indices before chunk `c+1`.
+ * The calling thread processes the first chunk.
+ * Runs serially when called from within another parallel task.
+ * Exceptions thrown by `f` are rethrown in the calling thread after all threads have finished.
+ */
+template <typename F>
+void parallelFor(std::size_t const n, F &&f)
+{
+    std::size_t const nchunks = numParallelChunks(n);
+    auto const chunkBegin = [n, nchunks](std::size_t const chunk) {
+        return chunk * n / nchunks;
+    };
+
+    std::vector<std::exception_ptr> exceptions(nchunks);
+    auto const process = [&](std::size_t const chunk) {
+        ParallelRegionGuard const guard;
+        try {
+            f(chunkBegin(chunk), chunkBegin(chunk+1), chunk);
+        }
+        catch (...) {
+            exceptions[chunk] = std::current_exception();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(nchunks - 1);
+    for (std::size_t chunk = 1; chunk < nchunks; ++chunk) {
+        threads.emplace_back(process, chunk);
+    }
+    process(0);
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    for (auto const &exception : exceptions) {
+        if (exception) {
+            std::rethrow_exception(exception);
+        }
+    }
+}
+
+
+/**
+ * Set the number of threads used by BLAS and LAPACK routines.
+ *
+ * Only has an effect if the BLAS library is parallel (see `BLAS_IS_PARALLEL`)
+ * and is OpenBLAS or Intel MKL.
+ * \return `true` if the number of threads was set, `false` otherwise.
+ */
+bool setBlasThreads(std::size_t n);
+
+
+/**
+ * A fixed number of worker threads that process tasks in the order they are submitted.
+ */
+class ThreadPool
+{
+public:
+    /// Start `nthreads` worker threads.
+    explicit ThreadPool(std::size_t nthreads);
+
+    /// Wait for all tasks and stop the workers.
+    ~ThreadPool();
+
+    ThreadPool(ThreadPool const &) = delete;
+    ThreadPool &operator=(ThreadPool const &) = delete;
+    ThreadPool(ThreadPool &&) = delete;
+    ThreadPool &operator=(ThreadPool &&) = delete;
+
+
+    /// Enqueue a task.
+    void submit(std::function<void()> task);
+
+
+    /**
+     * Block until all submitted tasks have finished.
+     * Rethrows the first exception thrown by any task since the last call to wait.
+     */
+    void wait();
+
+
+    /// Return the number of worker threads.
+    [[nodiscard]] std::size_t size() const noexcept;
+
+
+private:
+    void work();
+
+    std::vector<std::thread> workers_;
+    std::deque<std::function<void()>> tasks_;
+    std::mutex mutex_;
+    std::condition_variable taskAvailable_;
+    std::condition_variable tasksDone_;
+    std::size_t numRunning_ = 0;
+    bool stop_ = false;
+    std::exception_ptr exception_;
+};
+
+#endif //EXACT_HUBBARD_PARALLEL_HPP
@@ -3,62 +3,137 @@
 #include <blaze/math/lapack/syev.h>
 #include <blaze/math/Submatrix.h>
 
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <map>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include "hamiltonian.hpp"
+#include "matrix_free.hpp"
 #include "operator.hpp"
+#include "parallel.hpp"
 
 
 namespace {
-    /// Iterate over states and return groups of states that have the same charge.
-    class EqualChargeIter
+    /// Return the particle and hole numbers of a state.
+    std::pair<int, int> sectorOf(State const &state) noexcept
     {
-        /// The states to iterate over, sorted according to charge.
-        SumState const &basis_;
-        /// Current location in basis_.
-        std::size_t currentI_ = 0;
-        /// Charge of current state.
-        int currentCharge_ = 0;
-        /// Compute charges with this operator.
-        ChargeOperator Q_{};
+        return {state.numParticles(), state.numHoles()};
+    }
 
 
-    public:
-        /**
-         *  Construct for a basis.
-         * \attention The basis must be sorted according to charge.
-         */
-        explicit EqualChargeIter(SumState const &basis) : basis_{basis} { }
+    /**
+     * Return a seed for random numbers that only depends on the numbers of particles and holes,
+     * so it is the same for every basis that contains the sector.
+     */
+    unsigned sectorSeed(Sector const &sector) noexcept
+    {
+        return static_cast<unsigned>(sector.numParticles * static_cast<int>(maxNumSites + 1)
+                                     + sector.numHoles);
+    }
 
 
-        /// Return `true` if iteration has finished.
-        [[nodiscard]] bool finished() const noexcept
-        {
-            return currentI_ == basis_.size();
+    /**
+     * Find groups of states that have the same numbers of particles and holes.
+     * \attention The basis must be sorted according to sectorOf.
+     */
+    std::vector<Sector> findSectors(SumState const &basis)
+    {
+        std::vector<Sector> sectors;
+        for (std::size_t i = 0; i < basis.size();) {
+            auto const [numParticles, numHoles] = sectorOf(basis[i].second);
+            Sector sector{numParticles, numHoles, i, 0, 0, 0};
+            for (; i < basis.size()
+                   and sectorOf(basis[i].second) == std::pair{numParticles, numHoles};
+                   ++i) { }
+            sector.size = i - sector.offset;
+            sectors.push_back(sector);
         }
+        return sectors;
+    }
 
 
-        /// Return the next set of states and charge.
-        std::pair<SumState, int> next()
-        {
-            if (currentI_ == basis_.size()) {
-                throw std::runtime_error("EqualChargeIter ran out of states");
-            }
+    /// Copy the basis states of a sector.
+    SumState sectorBasis(SumState const &basis, Sector const &sector)
+    {
+        SumState res;
+        res.reserve(sector.size);
+        for (std::size_t i = sector.offset; i < sector.offset + sector.size; ++i) {
+            res.push(basis[i].first, basis[i].second);
+        }
+        return res;
+    }
 
-            SumState res;
-            // process first element manually to get new charge
-            currentCharge_ = Q_.computeCharge(basis_[currentI_].second);
-            res.push(basis_[currentI_].first, basis_[currentI_].second);
-            currentI_++;
 
-            // iterate over following elements with the same charge
-            for (; currentI_ < basis_.size()
-                   and Q_.computeCharge(basis_[currentI_].second) == currentCharge_;
-                   ++currentI_)
-            {
-                res.push(basis_[currentI_].first, basis_[currentI_].second);
+    /**
+     * Diagonalise all sectors in parallel.
+     *
+     * Sectors are processed in order of decreasing size so that the largest ones
+     * do not end up running alone at the end.
+     * Sectors that dominate the total cost are processed one at a time with all threads
+     * available to the parallelism within a sector, i.e. LAPACK if BLAS is parallel
+     * and the matrix-free Hamiltonian with Eigensolver::lanczos.
+     * All other sectors run concurrently with one thread each.
+     * Runs serially when called from within another parallel task.
+     * Calls `computeSector(s)` with the index `s` of each sector.
+     */
+    template <typename F>
+    void forEachSectorParallel(std::vector<Sector> const &sectors, Eigensolver const solver,
+                               F const &computeSector)
+    {
+        // indices of sectors
+        std::vector<std::size_t> ordered(sectors.size());
+        std::iota(ordered.begin(), ordered.end(), std::size_t{0});
+        std::stable_sort(ordered.begin(), ordered.end(),
+                         [&sectors](std::size_t const a, std::size_t const b) {
+                             return sectors[a].size > sectors[b].size;
+                         });
+
+        if (inParallelRegion()) {
+            for (auto const s : ordered) {
+                computeSector(s);
             }
+            return;
+        }
 
-            return std::pair{res, currentCharge_};
+        // Dense diagonalisation is cubic in the size,
+        // Lanczos is dominated by applying the Hamiltonian.
+        auto const cost = [&sectors, solver](std::size_t const s) {
+            return solver == Eigensolver::dense
+                   ? std::pow(static_cast<double>(sectors[s].size), 3)
+                   : static_cast<double>(sectors[s].size);
         };
-    };
+        double totalCost = 0.0;
+        for (auto const s : ordered) {
+            totalCost += cost(s);
+        }
+
+        std::size_t const nthreads = numThreads();
+        auto firstConcurrent = ordered.begin();
+        if (nthreads > 1
+            and (setBlasThreads(nthreads) or solver == Eigensolver::lanczos)) {
+            // A sector is too big if it takes longer than all others combined
+            // when they are spread over all threads.
+            while (firstConcurrent != ordered.end()
+                   and cost(*firstConcurrent) * static_cast<double>(nthreads) > totalCost) {
+                computeSector(*firstConcurrent);
+                totalCost -= cost(*firstConcurrent);
+                ++firstConcurrent;
+            }
+            setBlasThreads(1);
+        }
+
+        ThreadPool pool{std::min(nthreads, static_cast<std::size_t>(ordered.end() - firstConcurrent))};
+        for (auto it = firstConcurrent; it != ordered.end(); ++it) {
+            pool.submit([&computeSector, s = *it] { computeSector(s); });
+        }
+        pool.wait();
+        setBlasThreads(nthreads);
+    }
 
 
     /// Construct a state from coefficients and a basis.
@@ -76,83 +151,556 @@ namespace {
     }
 
 
-    /**
-     * Compute the spectrum for a given charge.
-     *
-     * Stores the result in `spectrum[insertionOffset+i]`
-     * for `0 <= i < basis.size()`.
-     * Increases `insertionOffset` to point past the inserted values.
-     */
-    void computeSubSpectrum(SumState const &basis, int const charge,
-                            Spectrum &out, std::size_t &insertionOffset)
-    {
-        // compute spectrum
-        SumOperator hamiltonian{ParticleHop{},
-                                HoleHop{},
-                                SquaredNumberOperator{}};
-        DMatrix matrix = toMatrix(hamiltonian, basis);
+    /// Eigenstates of a single sector.
+    struct SectorEigenstates
+    {
+        std::vector<double> energies;
+        std::vector<std::vector<std::size_t>> idxs;
+        std::vector<std::vector<double>> coeffs;
+
+
+        /// Store an eigenvalue and eigenvector in the basis of the sector.
+        void push(Sector const &sector, double const energy, DVector const &vector)
+        {
+            energies.push_back(energy);
+            idxs.emplace_back();
+            coeffs.emplace_back();
+            for (std::size_t j = 0; j < vector.size(); ++j) {
+                if (double const coef = vector[j]; std::abs(coef) > 1e-13) {
+                    idxs.back().push_back(sector.offset + j);
+                    coeffs.back().push_back(coef);
+                }
+            }
+        }
+
+
+        /// Store all eigenstates in a checkpoint record.
+        [[nodiscard]] Checkpoint::Record toRecord() const
+        {
+            Checkpoint::Record record;
+            record.reals.push_back(energies);
+            record.reals.insert(record.reals.end(), coeffs.begin(), coeffs.end());
+            for (auto const &idx : idxs) {
+                record.integers.emplace_back(idx.begin(), idx.end());
+            }
+            return record;
+        }
+
+
+        /// Restore eigenstates from a checkpoint record made by toRecord.
+        static SectorEigenstates fromRecord(Checkpoint::Record const &record)
+        {
+            SectorEigenstates res;
+            res.energies = record.reals.at(0);
+            res.coeffs.assign(record.reals.begin() + 1, record.reals.end());
+            for (auto const &idx : record.integers) {
+                res.idxs.emplace_back(idx.begin(), idx.end());
+            }
+            if (res.coeffs.size() != res.energies.size()
+                or res.idxs.size() != res.energies.size()) {
+                throw std::runtime_error("Inconsistent checkpoint of a sector");
+            }
+            return res;
+        }
+
+
+        /// Remove states whose Boltzmann weight relative to the lowest state is below the cutoff.
+        void applyBoltzmannCutoff(double const beta, double const cutoff)
+        {
+            if (energies.empty()) {
+                return;
+            }
+            double const maxEnergy = *std::min_element(energies.begin(), energies.end())
+                                     - std::log(cutoff) / beta;
+
+            std::size_t numKept = 0;
+            for (std::size_t i = 0; i < energies.size(); ++i) {
+                if (energies[i] > maxEnergy) {
+                    continue;
+                }
+                if (numKept != i) {
+                    energies[numKept] = energies[i];
+                    idxs[numKept] = std::move(idxs[i]);
+                    coeffs[numKept] = std::move(coeffs[i]);
+                }
+                ++numKept;
+            }
+            energies.resize(numKept);
+            idxs.resize(numKept);
+            coeffs.resize(numKept);
+        }
+    };
+
+
+    /// Diagonalise a Hamiltonian matrix fully and store all eigenstates.
+    void diagonaliseDense(DMatrix matrix, DSparseMatrix const *subspace,
+                          Sector const &sector, SectorEigenstates &out)
+    {
         DVector evals(matrix.rows());
         blaze::syev(matrix, evals, 'V', 'U');
 
-        // store spectrum
+        DVector coeffs(sector.size);
         for (std::size_t i = 0; i < evals.size(); ++i) {
-            out.charges[insertionOffset + i] = charge;
-            out.energies[insertionOffset + i] = evals[i];
-
             // `syev` stores the eigenvectors row-wise in `matrix`.
-            for (std::size_t j = 0; j < matrix.columns(); ++j) {
-                if (double const coef = matrix(i, j); std::abs(coef) > 1e-13) {
-                    out.eigenStateIdxs[insertionOffset + i].push_back(insertionOffset + j);
-                    out.eigenStateCoeffs[insertionOffset + i].push_back(coef);
+            reset(coeffs);
+            if (subspace == nullptr) {
+                for (std::size_t j = 0; j < sector.size; ++j) {
+                    coeffs[j] = matrix(i, j);
+                }
+            }
+            else {
+                // transform eigenvector back to sector basis
+                for (std::size_t k = 0; k < subspace->rows(); ++k) {
+                    for (auto it = subspace->cbegin(k); it != subspace->cend(k); ++it) {
+                        coeffs[it->index()] += matrix(i, k) * it->value();
+                    }
+                }
+            }
+            out.push(sector, evals[i], coeffs);
+        }
+    }
+
+
+    /**
+     * Compute the spectrum for a given sector.
+     *
+     * Diagonalises the Hamiltonian in each symmetry adapted subspace of the sector separately.
+     * Computes all eigenstates with Eigensolver::dense and only low-lying ones
+     * with Eigensolver::lanczos.
+     */
+    SectorEigenstates computeSubSpectrum(SumState const &basis, Sector const &sector,
+                                         LatticeSymmetry const &symmetry,
+                                         HubbardParameters const &parameters,
+                                         Eigensolver const solver,
+                                         LanczosSettings const &lanczosSettings)
+    {
+        HubbardHamiltonian const hamiltonian{parameters.kappa, parameters.U};
+        BasisIndex const index{basis};
+        SectorEigenstates res;
+
+        if (solver == Eigensolver::dense) {
+            DSparseMatrix const hamiltonianMatrix = toSparseMatrix(hamiltonian, basis, index);
+            if (symmetry.order() == 1) {
+                diagonaliseDense(hamiltonianMatrix, nullptr, sector, res);
+            }
+            else {
+                // `subspace` stores symmetry adapted basis vectors row-wise.
+                for (auto const &subspace : symmetry.decompose(basis, index)) {
+                    diagonaliseDense(subspace * hamiltonianMatrix * trans(subspace),
+                                     &subspace, sector, res);
+                }
+            }
+            assert(res.energies.size() == sector.size);
+            return res;
+        }
+
+        // Seed with the sector to get reproducible results independent of scheduling.
+        auto const seed = sectorSeed(sector);
+        if (symmetry.order() == 1) {
+            auto const eigenpairs = lanczosLowest(
+                    [&](DVector const &x, DVector &y) {
+                        applyMatrixFree(hamiltonian, basis, index, x, y);
+                    },
+                    basis.size(), lanczosSettings, seed);
+            for (std::size_t i = 0; i < eigenpairs.values.size(); ++i) {
+                res.push(sector, eigenpairs.values[i], eigenpairs.vectors[i]);
+            }
+        }
+        else {
+            // Project once per subspace, assembling S H S^T from matrix-vector products
+            // would cost a full sector application per subspace dimension.
+            DSparseMatrix const hamiltonianMatrix = toSparseMatrix(hamiltonian, basis, index);
+            for (auto const &subspace : symmetry.decompose(basis, index)) {
+                DSparseMatrix const projected = subspace * hamiltonianMatrix * trans(subspace);
+                auto const eigenpairs = lanczosLowest(projected, lanczosSettings, seed);
+                for (std::size_t i = 0; i < eigenpairs.values.size(); ++i) {
+                    res.push(sector, eigenpairs.values[i],
+                             trans(subspace) * eigenpairs.vectors[i]);
+                }
+            }
+            // Subspaces apply the cutoff relative to their own lowest state, use the sector's.
+            res.applyBoltzmannCutoff(lanczosSettings.beta, lanczosSettings.boltzmannCutoff);
+        }
+        return res;
+    }
+
+
+    /**
+     * Compute the spectrum for a given sector from pre-assembled matrices.
+     * Like the overload above but only forms H = kappa K + U/2 V in each subspace.
+     */
+    SectorEigenstates computeSubSpectrum(std::vector<SplitHamiltonian::Subspace> const &subspaces,
+                                         Sector const &sector,
+                                         HubbardParameters const &parameters,
+                                         Eigensolver const solver,
+                                         LanczosSettings const &lanczosSettings)
+    {
+        SectorEigenstates res;
+        auto const seed = sectorSeed(sector);
+        for (auto const &subspace : subspaces) {
+            DSparseMatrix const hamiltonianMatrix(parameters.kappa * subspace.hopping
+                                                  + parameters.U / 2.0 * subspace.interaction);
+            if (solver == Eigensolver::dense) {
+                diagonaliseDense(DMatrix(hamiltonianMatrix), &subspace.basis, sector, res);
+            }
+            else {
+                auto const eigenpairs = lanczosLowest(hamiltonianMatrix, lanczosSettings, seed);
+                for (std::size_t i = 0; i < eigenpairs.values.size(); ++i) {
+                    res.push(sector, eigenpairs.values[i],
+                             trans(subspace.basis) * eigenpairs.vectors[i]);
                 }
             }
         }
 
-        // continue inserting after the new elements
-        insertionOffset += evals.size();
+        if (solver == Eigensolver::dense) {
+            assert(res.energies.size() == sector.size);
+        }
+        else {
+            res.applyBoltzmannCutoff(lanczosSettings.beta, lanczosSettings.boltzmannCutoff);
+        }
+        return res;
+    }
+
+
+    /// Sort basis states wrt. numbers of particles and holes.
+    SumState sortedBySector(SumState basis)
+    {
+        // The Hamiltonian conserves both separately and is block diagonal in them.
+        auto const bySector = [](State const &a, State const &b) {
+            return sectorOf(a) < sectorOf(b);
+        };
+        // fockspaceBasis is already sorted, keep its order within sectors
+        if (not std::is_sorted(std::as_const(basis).states(),
+                               std::as_const(basis).states() + basis.size(), bySector)) {
+            std::sort(basis.states(), basis.states() + basis.size(), bySector);
+        }
+        return basis;
+    }
+
+
+    /// Concatenate the eigenstates of all sectors and store them in `spectrum`.
+    void collectEigenstates(Spectrum &spectrum, std::vector<SectorEigenstates> &results)
+    {
+        std::size_t numEigenstates = 0;
+        for (std::size_t s = 0; s < spectrum.sectors.size(); ++s) {
+            spectrum.sectors[s].eigenstateOffset = numEigenstates;
+            spectrum.sectors[s].numEigenstates = results[s].energies.size();
+            numEigenstates += results[s].energies.size();
+        }
+        spectrum.charges.resize(numEigenstates);
+        spectrum.energies.resize(numEigenstates);
+        spectrum.eigenStateIdxs.reserve(numEigenstates);
+        spectrum.eigenStateCoeffs.reserve(numEigenstates);
+        for (std::size_t s = 0; s < spectrum.sectors.size(); ++s) {
+            auto const &sector = spectrum.sectors[s];
+            for (std::size_t i = 0; i < sector.numEigenstates; ++i) {
+                spectrum.charges[sector.eigenstateOffset + i] = sector.charge();
+                spectrum.energies[sector.eigenstateOffset + i] = results[s].energies[i];
+            }
+            std::move(results[s].idxs.begin(), results[s].idxs.end(),
+                      std::back_inserter(spectrum.eigenStateIdxs));
+            std::move(results[s].coeffs.begin(), results[s].coeffs.end(),
+                      std::back_inserter(spectrum.eigenStateCoeffs));
+        }
+    }
+
+
+    /// Construct an n x n identity matrix.
+    DSparseMatrix identityMatrix(std::size_t const n)
+    {
+        DSparseMatrix mat(n, n);
+        mat.reserve(n);
+        for (std::size_t i = 0; i < n; ++i) {
+            mat.append(i, i, 1.0);
+            mat.finalize(i);
+        }
+        return mat;
     }
 }
 
 
-Spectrum::Spectrum(SumState const &inBasis)
-        : charges(inBasis.size()), energies(inBasis.size()),
-          eigenStateIdxs(inBasis.size()), eigenStateCoeffs(inBasis.size()),
-          basis(inBasis)
+SplitHamiltonian::SplitHamiltonian(SumState const &inBasis, LatticeSymmetry const &symmetry)
+        : basis_{sortedBySector(inBasis)}, sectors_{findSectors(basis_)},
+          subspaces_(sectors_.size())
+{
+    // Assembly is linear in the size of sectors, like Lanczos.
+    forEachSectorParallel(sectors_, Eigensolver::lanczos, [&](std::size_t const s) {
+        SumState const basis = sectorBasis(basis_, sectors_[s]);
+        BasisIndex const index{basis};
+        DSparseMatrix const hopping = toSparseMatrix(HubbardHamiltonian{1.0, 0.0},
+                                                     basis, index);
+        DSparseMatrix const interaction = toSparseMatrix(SquaredNumberOperator<false>{},
+                                                         basis, index);
+
+        if (symmetry.order() == 1) {
+            subspaces_[s].push_back({identityMatrix(basis.size()), hopping, interaction});
+        }
+        else {
+            for (auto &subspace : symmetry.decompose(basis, index)) {
+                DSparseMatrix projectedHopping(subspace * hopping * trans(subspace));
+                DSparseMatrix projectedInteraction(subspace * interaction * trans(subspace));
+                subspaces_[s].push_back({std::move(subspace),
+                                         std::move(projectedHopping),
+                                         std::move(projectedInteraction)});
+            }
+        }
+    });
+}
+
+
+SumState const &SplitHamiltonian::basis() const noexcept
+{
+    return basis_;
+}
+
+
+std::vector<Sector> const &SplitHamiltonian::sectors() const noexcept
+{
+    return sectors_;
+}
+
+
+std::vector<SplitHamiltonian::Subspace> const &
+SplitHamiltonian::subspaces(std::size_t const sector) const noexcept
+{
+    assert(sector < subspaces_.size());
+    return subspaces_[sector];
+}
+
+
+Spectrum::Spectrum(SumState inBasis)
+        : basis(std::move(inBasis))
 { }
 
 
-Spectrum Spectrum::compute(SumState const &inBasis)
+Spectrum Spectrum::compute(SumState const &inBasis, LatticeSymmetry const &symmetry,
+                           HubbardParameters const &parameters,
+                           Eigensolver const solver, LanczosSettings const &lanczosSettings,
+                           Checkpoint const *const checkpoint)
+{
+    Spectrum spectrum(sortedBySector(inBasis));
+    spectrum.parameters = parameters;
+    spectrum.basisIndex = BasisIndex{spectrum.basis};
+
+    // Compute spectrum for each sector.
+    // Sectors write to separate elements of `results`, so they can be processed concurrently.
+    spectrum.sectors = findSectors(spectrum.basis);
+    std::vector<SectorEigenstates> results(spectrum.sectors.size());
+    forEachSectorParallel(spectrum.sectors, solver, [&](std::size_t const s) {
+        auto const unit = "sector" + std::to_string(s);
+        if (checkpoint) {
+            if (auto const record = checkpoint->load(unit)) {
+                results[s] = SectorEigenstates::fromRecord(*record);
+                return;
+            }
+        }
+
+        auto const &sector = spectrum.sectors[s];
+        results[s] = computeSubSpectrum(sectorBasis(spectrum.basis, sector), sector,
+                                        symmetry, parameters, solver, lanczosSettings);
+        if (checkpoint) {
+            checkpoint->save(unit, results[s].toRecord());
+        }
+    });
+
+    collectEigenstates(spectrum, results);
+    return spectrum;
+}
+
+
+Spectrum Spectrum::compute(SplitHamiltonian const &hamiltonian,
+                           HubbardParameters const &parameters,
+                           Eigensolver const solver, LanczosSettings const &lanczosSettings)
 {
-    Spectrum spectrum(inBasis);
+    Spectrum spectrum(hamiltonian.basis());
+    spectrum.parameters = parameters;
+    spectrum.basisIndex = BasisIndex{spectrum.basis};
+
+    spectrum.sectors = hamiltonian.sectors();
+    std::vector<SectorEigenstates> results(spectrum.sectors.size());
+    forEachSectorParallel(spectrum.sectors, solver, [&](std::size_t const s) {
+        results[s] = computeSubSpectrum(hamiltonian.subspaces(s), spectrum.sectors[s],
+                                        parameters, solver, lanczosSettings);
+    });
+
+    collectEigenstates(spectrum, results);
+    return spectrum;
+}
 
-    // sort wrt. charge
-    ChargeOperator Q{};
-    std::sort(spectrum.basis.states(), spectrum.basis.states() + spectrum.basis.size(),
-              [&Q](State const &a, State const &b) {
-                  return Q.computeCharge(a) < Q.computeCharge(b);
-              });
 
-    // compute spectrum for given charge
-    std::size_t insertionOffset = 0;
-    for (EqualChargeIter eci{spectrum.basis}; not eci.finished();) {
-        auto const [subBasis, charge] = eci.next();
-        computeSubSpectrum(subBasis, charge, spectrum, insertionOffset);
+Spectrum Spectrum::fromEigenstates(SumState inBasis, HubbardParameters const &parameters,
+                                   std::vector<Sector> sectors, DVector energies,
+                                   std::vector<std::vector<std::size_t>> eigenStateIdxs,
+                                   std::vector<std::vector<double>> eigenStateCoeffs)
+{
+    std::size_t const numEigenstates = energies.size();
+    if (eigenStateIdxs.size() != numEigenstates or eigenStateCoeffs.size() != numEigenstates) {
+        throw std::invalid_argument("Need one eigenvector per energy.");
     }
 
+    Spectrum spectrum(std::move(inBasis));
+    spectrum.parameters = parameters;
+    spectrum.sectors = std::move(sectors);
+    spectrum.charges.resize(numEigenstates);
+    for (auto const &sector : spectrum.sectors) {
+        if (sector.offset + sector.size > spectrum.basis.size()
+            or sector.eigenstateOffset + sector.numEigenstates > numEigenstates) {
+            throw std::invalid_argument("Sector exceeds the basis or eigenstates.");
+        }
+        for (std::size_t i = 0; i < sector.numEigenstates; ++i) {
+            spectrum.charges[sector.eigenstateOffset + i] = sector.charge();
+        }
+    }
+    for (std::size_t i = 0; i < numEigenstates; ++i) {
+        if (eigenStateIdxs[i].size() != eigenStateCoeffs[i].size()) {
+            throw std::invalid_argument("Need one coefficient per index of each eigenvector.");
+        }
+        for (auto const idx : eigenStateIdxs[i]) {
+            if (idx >= spectrum.basis.size()) {
+                throw std::invalid_argument("Eigenvector index exceeds the basis.");
+            }
+        }
+    }
+    spectrum.energies = std::move(energies);
+    spectrum.eigenStateIdxs = std::move(eigenStateIdxs);
+    spectrum.eigenStateCoeffs = std::move(eigenStateCoeffs);
+    spectrum.basisIndex = BasisIndex{spectrum.basis};
     return spectrum;
 }
 
 
+void forEachSpectrum(SplitHamiltonian const &hamiltonian,
+                     std::vector<HubbardParameters> const &parameters,
+                     Eigensolver const solver, LanczosSettings const &lanczosSettings,
+                     std::function<void(std::size_t, Spectrum const &)> const &process)
+{
+    std::size_t const nthreads = numThreads();
+    if (parameters.size() < nthreads) {
+        for (std::size_t p = 0; p < parameters.size(); ++p) {
+            process(p, Spectrum::compute(hamiltonian, parameters[p], solver, lanczosSettings));
+        }
+        return;
+    }
+
+    setBlasThreads(1);
+    {
+        ThreadPool pool{nthreads};
+        for (std::size_t p = 0; p < parameters.size(); ++p) {
+            pool.submit([&, p] {
+                process(p, Spectrum::compute(hamiltonian, parameters[p], solver, lanczosSettings));
+            });
+        }
+        pool.wait();
+    }
+    setBlasThreads(nthreads);
+}
+
+
 std::size_t Spectrum::size() const noexcept
 {
     assert(charges.size() == energies.size());
     assert(charges.size() == eigenStateIdxs.size());
     assert(charges.size() == eigenStateCoeffs.size());
-    assert(charges.size() == basis.size());
+    assert(charges.size() <= basis.size());
     return charges.size();
 }
 
 
+namespace {
+    /**
+     * Store the eigenvectors of a sector column-wise in a dense matrix.
+     * Rows correspond to the basis states of the sector.
+     */
+    DMatrix sectorEigenvectors(Spectrum const &spectrum, Sector const &sector)
+    {
+        DMatrix vectors(sector.size, sector.numEigenstates, 0.0);
+        for (std::size_t a = 0; a < sector.numEigenstates; ++a) {
+            auto const &idxs = spectrum.eigenStateIdxs[sector.eigenstateOffset + a];
+            auto const &coeffs = spectrum.eigenStateCoeffs[sector.eigenstateOffset + a];
+            for (std::size_t k = 0; k < idxs.size(); ++k) {
+                vectors(idxs[k] - sector.offset, a) = coeffs[k];
+            }
+        }
+        return vectors;
+    }
+
+
+    /// Find all pairs of sectors (row, column) that a matrix in the Fock basis couples.
+    std::vector<std::pair<std::size_t, std::size_t>>
+    coupledSectors(DSparseMatrix const &matrix, Spectrum const &spectrum)
+    {
+        std::vector<std::size_t> sectorOfIndex(spectrum.basis.size());
+        for (std::size_t s = 0; s < spectrum.sectors.size(); ++s) {
+            auto const &sector = spectrum.sectors[s];
+            std::fill_n(sectorOfIndex.begin() + static_cast<std::ptrdiff_t>(sector.offset),
+                        sector.size, s);
+        }
+
+        std::size_t const nsectors = spectrum.sectors.size();
+        std::vector<bool> coupled(nsectors * nsectors, false);
+        for (std::size_t i = 0; i < matrix.rows(); ++i) {
+            for (auto it = matrix.cbegin(i); it != matrix.cend(i); ++it) {
+                coupled[sectorOfIndex[i] * nsectors + sectorOfIndex[it->index()]] = true;
+            }
+        }
+
+        std::vector<std::pair<std::size_t, std::size_t>> pairs;
+        for (std::size_t row = 0; row < nsectors; ++row) {
+            for (std::size_t column = 0; column < nsectors; ++column) {
+                if (coupled[row * nsectors + column]
+                    and spectrum.sectors[row].numEigenstates > 0
+                    and spectrum.sectors[column].numEigenstates > 0) {
+                    pairs.emplace_back(row, column);
+                }
+            }
+        }
+        return pairs;
+    }
+
+
+    /**
+     * Call `computeBlock(p)` for every pair of sectors `pairs[p]` (row, column) in parallel.
+     *
+     * Pairs are processed in order of decreasing cost, see forEachSectorParallel.
+     * Runs serially when called from within another parallel task.
+     */
+    template <typename F>
+    void forEachBlockParallel(std::vector<std::pair<std::size_t, std::size_t>> const &pairs,
+                              Spectrum const &spectrum, F const &computeBlock)
+    {
+        std::vector<std::size_t> ordered(pairs.size());
+        std::iota(ordered.begin(), ordered.end(), std::size_t{0});
+        auto const cost = [&](std::size_t const p) {
+            auto const &row = spectrum.sectors[pairs[p].first];
+            auto const &column = spectrum.sectors[pairs[p].second];
+            return row.size * row.numEigenstates * column.numEigenstates;
+        };
+        std::stable_sort(ordered.begin(), ordered.end(),
+                         [&](std::size_t const a, std::size_t const b) {
+                             return cost(a) > cost(b);
+                         });
+
+        if (inParallelRegion()) {
+            for (auto const p : ordered) {
+                computeBlock(p);
+            }
+            return;
+        }
+
+        std::size_t const nthreads = numThreads();
+        setBlasThreads(1);
+        {
+            ThreadPool pool{std::min(nthreads, pairs.size())};
+            for (auto const p : ordered) {
+                pool.submit([&computeBlock, p] { computeBlock(p); });
+            }
+            pool.wait();
+        }
+        setBlasThreads(nthreads);
+    }
+}
+
+
 /*
  * Given eigenstates
  *   |alpha> = sum_x alpha_x |x>
@@ -162,31 +710,120 @@ std::size_t Spectrum::size() const noexcept
  *   A^{alpha,gamma} = sum_x sum_y <x| alpha_x A gamma_y |y>
  *                   = sum_x sum_y alpha_x gamma_y <x|A|y>
  *                   = sum_x sum_y alpha_x gamma_y A^{xy}
+ * Eigenstates lie in sectors, so for each pair of sectors Q', Q
+ *   A_{Q'Q}^{eigen} = V_{Q'}^T A_{Q'Q} V_Q
+ * where the columns of V_Q are the eigenvectors of sector Q.
+ * A_{Q'Q} V_Q is a sparse-dense product and the rest is a dense matrix product.
  */
-DSparseMatrix toEigenspaceMatrix(DMatrix const &matrix, Spectrum const &spectrum)
+BlockSparseMatrix toEigenspaceMatrix(DSparseMatrix const &matrix, Spectrum const &spectrum)
 {
-    DSparseMatrix res(matrix.rows(), matrix.columns());
-
-    // Iterate over elements of result A^{alpha,gamma}
-    for (std::size_t alpha = 0; alpha < spectrum.size(); ++alpha) {
-        for (std::size_t gamma = 0; gamma < spectrum.size(); ++gamma) {
-            double elem = 0.0;
-
-            // Iterate over basis states
-            for (std::size_t x = 0; x < spectrum.eigenStateIdxs[alpha].size(); ++x) {
-                for (std::size_t y = 0; y < spectrum.eigenStateIdxs[gamma].size(); ++y) {
-                    elem += spectrum.eigenStateCoeffs[alpha][x]
-                            * spectrum.eigenStateCoeffs[gamma][y]
-                            * matrix(spectrum.eigenStateIdxs[alpha][x],
-                                     spectrum.eigenStateIdxs[gamma][y]);
+    auto const pairs = coupledSectors(matrix, spectrum);
+    std::vector<BlockSparseMatrix::Block> blocks(pairs.size());
+
+    forEachBlockParallel(pairs, spectrum, [&](std::size_t const p) {
+        auto const &row = spectrum.sectors[pairs[p].first];
+        auto const &column = spectrum.sectors[pairs[p].second];
+        DMatrix const columnVectors = sectorEigenvectors(spectrum, column);
+
+        // A_{Q'Q} V_Q
+        DMatrix product(row.size, column.numEigenstates, 0.0);
+        for (std::size_t x = 0; x < row.size; ++x) {
+            for (auto it = matrix.cbegin(row.offset + x);
+                 it != matrix.cend(row.offset + x); ++it) {
+                if (it->index() < column.offset
+                    or it->index() >= column.offset + column.size) {
+                    continue;
+                }
+                for (std::size_t gamma = 0; gamma < column.numEigenstates; ++gamma) {
+                    product(x, gamma) += it->value()
+                                         * columnVectors(it->index() - column.offset, gamma);
                 }
             }
+        }
+
+        blocks[p] = BlockSparseMatrix::Block{
+            pairs[p].first, pairs[p].second,
+            row.eigenstateOffset, column.eigenstateOffset,
+            trans(sectorEigenvectors(spectrum, row)) * product
+        };
+    });
+
+    return BlockSparseMatrix{spectrum.size(), spectrum.size(), std::move(blocks)};
+}
 
-            if (blaze::abs(elem) > 1e-8) {
-                res(alpha, gamma) = elem;
+
+std::vector<BlockSparseMatrix> particleAnnihilatorEigenspaceMatrices(Spectrum const &spectrum)
+{
+    std::size_t const numSites = lattice().numSites();
+
+    // (Np-1, Nh) <- (Np, Nh), annihilators couple no other sectors
+    std::map<std::pair<int, int>, std::size_t> sectorIndex;
+    for (std::size_t s = 0; s < spectrum.sectors.size(); ++s) {
+        sectorIndex.emplace(std::pair{spectrum.sectors[s].numParticles,
+                                      spectrum.sectors[s].numHoles}, s);
+    }
+    std::vector<std::pair<std::size_t, std::size_t>> pairs;
+    for (std::size_t column = 0; column < spectrum.sectors.size(); ++column) {
+        auto const &sector = spectrum.sectors[column];
+        auto const row = sectorIndex.find({sector.numParticles - 1, sector.numHoles});
+        if (row != sectorIndex.end() and sector.numEigenstates > 0
+            and spectrum.sectors[row->second].numEigenstates > 0) {
+            pairs.emplace_back(row->second, column);
+        }
+    }
+
+    std::vector<std::vector<BlockSparseMatrix::Block>> blocks(
+            numSites, std::vector<BlockSparseMatrix::Block>(pairs.size()));
+    forEachBlockParallel(pairs, spectrum, [&](std::size_t const p) {
+        auto const &row = spectrum.sectors[pairs[p].first];
+        auto const &column = spectrum.sectors[pairs[p].second];
+        // shared by all sites
+        DMatrix const rowVectors = sectorEigenvectors(spectrum, row);
+        DMatrix const columnVectors = sectorEigenvectors(spectrum, column);
+
+        DMatrix product(row.size, column.numEigenstates);
+        ScratchSumState out{1};
+        for (std::size_t i = 0; i < numSites; ++i) {
+            ParticleAnnihilator const annihilator{i};
+
+            // a_i V_Q, each basis state is mapped to at most one other
+            reset(product);
+            for (std::size_t x = 0; x < column.size; ++x) {
+                auto const &[coefx, statex] = spectrum.basis[column.offset + x];
+                out->clear();
+                annihilator.apply(statex, *out);
+                for (std::size_t k = 0; k < out->size(); ++k) {
+                    auto const &[coefk, statek] = std::as_const(*out)[k];
+                    std::size_t const y = spectrum.basisIndex.find(statek);
+                    if (y == BasisIndex::npos) {
+                        continue;
+                    }
+                    assert(y >= row.offset and y < row.offset + row.size);
+                    double const coef = coefk * spectrum.basis[y].first * coefx;
+                    for (std::size_t gamma = 0; gamma < column.numEigenstates; ++gamma) {
+                        product(y - row.offset, gamma) += coef * columnVectors(x, gamma);
+                    }
+                }
             }
+
+            blocks[i][p] = BlockSparseMatrix::Block{
+                pairs[p].first, pairs[p].second,
+                row.eigenstateOffset, column.eigenstateOffset,
+                trans(rowVectors) * product
+            };
         }
+    });
+
+    std::vector<BlockSparseMatrix> matrices;
+    matrices.reserve(numSites);
+    for (auto &siteBlocks : blocks) {
+        matrices.emplace_back(spectrum.size(), spectrum.size(), std::move(siteBlocks));
     }
+    return matrices;
+}
+
 
-    return res;
+BlockSparseMatrix toEigenspaceMatrix(DMatrix const &matrix, Spectrum const &spectrum)
+{
+    return toEigenspaceMatrix(DSparseMatrix(matrix), spectrum);
 }
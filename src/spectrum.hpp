@@ -5,17 +5,132 @@
  * \brief Spectrum storage and computation.
  */
 
+#include <functional>
 #include <utility>
 #include <vector>
 
+#include "basis_index.hpp"
+#include "block_sparse.hpp"
+#include "checkpoint.hpp"
+#include "lanczos.hpp"
 #include "linalg.hpp"
+#include "operator.hpp"
 #include "state.hpp"
+#include "symmetry.hpp"
+
+
+/**
+ * A block of states with fixed numbers of particles and holes.
+ *
+ * The Hamiltonian conserves the numbers of particles and holes separately
+ * and is thus block diagonal in sectors.
+ */
+struct Sector
+{
+    /// Number of particles of all states in the sector.
+    int numParticles;
+    /// Number of holes of all states in the sector.
+    int numHoles;
+    /// Index of the first state of the sector in the basis.
+    std::size_t offset;
+    /// Number of states in the sector.
+    std::size_t size;
+    /// Index of the first eigenstate of the sector in the spectrum.
+    std::size_t eigenstateOffset;
+    /// Number of eigenstates of the sector, less than `size` if only low-lying states were computed.
+    std::size_t numEigenstates;
+
+
+    /// Return the charge of all states in the sector.
+    [[nodiscard]] constexpr int charge() const noexcept
+    {
+        return numParticles - numHoles;
+    }
+};
+
+
+/**
+ * Parameters of the Hamiltonian
+ *   H = kappa K + U/2 V
+ * where K is the nearest-neighbour hopping and V = sum_x (n_x - \tilde{n}_x)^2.
+ */
+struct HubbardParameters
+{
+    /// On-site interaction strength.
+    double U = ::U;
+    /// Nearest-neighbour hopping parameter.
+    double kappa = ::kappa;
+};
+
+
+/// Algorithms for diagonalising the Hamiltonian.
+enum class Eigensolver
+{
+    /// Compute all eigenstates with LAPACK.
+    dense,
+    /// Compute only low-lying eigenstates of each sector, see lanczosLowest.
+    lanczos
+};
+
+
+/**
+ * Hopping and interaction terms of the Hamiltonian
+ *   H = kappa K + U/2 V
+ * assembled separately for each sector and symmetry adapted subspace.
+ *
+ * The matrices do not depend on U and kappa, so they can be assembled once
+ * and used to compute spectra for many parameters, see forEachSpectrum.
+ * Requires more memory than Spectrum::compute with Eigensolver::lanczos
+ * because all matrices are stored.
+ */
+class SplitHamiltonian
+{
+public:
+    /// Matrices of a symmetry adapted subspace of a sector.
+    struct Subspace
+    {
+        /// Basis vectors of the subspace stored row-wise as coefficients of the sector basis.
+        DSparseMatrix basis;
+        /// Hopping term K with kappa = 1 projected onto the subspace.
+        DSparseMatrix hopping;
+        /// Interaction term V projected onto the subspace.
+        DSparseMatrix interaction;
+    };
+
+
+    /**
+     * Assemble the matrices for all sectors.
+     * \param inBasis Basis states, must be normalised.
+     * \param symmetry Lattice symmetries used to block diagonalise the Hamiltonian.
+     */
+    SplitHamiltonian(SumState const &inBasis, LatticeSymmetry const &symmetry);
+
+
+    /// Return the basis ordered by sectors.
+    [[nodiscard]] SumState const &basis() const noexcept;
+
+    /// Return all sectors, the fields for eigenstates are not set.
+    [[nodiscard]] std::vector<Sector> const &sectors() const noexcept;
+
+    /// Return the symmetry adapted subspaces of a sector.
+    [[nodiscard]] std::vector<Subspace> const &subspaces(std::size_t sector) const noexcept;
+
+
+private:
+    SumState basis_;
+    std::vector<Sector> sectors_;
+    std::vector<std::vector<Subspace>> subspaces_;
+};
 
 
 /**
  * Stores an energy spectrum and associated eigenstates.
  *
- * The eigenstates are simultaneous eigenvectors of the Hamiltonian and charge operators.
+ * The eigenstates are simultaneous eigenvectors of the Hamiltonian,
+ * particle number, and hole number operators.
+ * Basis and eigenstates are grouped into sectors, the eigenstates of a sector are
+ * stored in `[sector.eigenstateOffset, sector.eigenstateOffset + sector.numEigenstates)`.
+ * If only low-lying states are computed, there are fewer eigenstates than basis states.
  * The basis and all eigenstates are normalised.
  *
  * The states are stored via index and coefficient lists based on the basis.
@@ -33,6 +148,10 @@ for (std::size_t j = 0; j < indexes.size(); ++j) {
  */
 struct Spectrum
 {
+    /// Parameters of the Hamiltonian the spectrum was computed for.
+    HubbardParameters parameters;
+    /// Sectors of basis and eigenstates, ordered by number of particles and holes.
+    std::vector<Sector> sectors;
     /// Expectation value of the charge operator for each eigenstate.
     IVector charges;
     /// Expectation value of the Hamiltonian for each eigenstate.
@@ -43,15 +162,61 @@ struct Spectrum
     std::vector<std::vector<double>> eigenStateCoeffs;
     /// Basis elements.
     SumState basis;
+    /// Maps states to their index in `basis`.
+    BasisIndex basisIndex;
 
 
     /// Computes the spectrum for a given basis.
     /**
      * \param inBasis Basis states, must be normalised.
+     * \param symmetry Lattice symmetries used to block diagonalise the Hamiltonian.
+     * \param parameters Parameters of the Hamiltonian.
+     * \param solver Algorithm to diagonalise the Hamiltonian in each sector with.
+     * \param lanczosSettings Parameters for Eigensolver::lanczos, ignored otherwise.
+     * \param checkpoint If not null, load the eigenstates of sectors that have already
+     *                   been computed from it and store all newly computed sectors in it.
      * \return A new instance of Spectrum-
      */
-    static Spectrum compute(SumState const &inBasis);
+    static Spectrum compute(SumState const &inBasis, LatticeSymmetry const &symmetry,
+                            HubbardParameters const &parameters = {},
+                            Eigensolver solver = Eigensolver::dense,
+                            LanczosSettings const &lanczosSettings = {},
+                            Checkpoint const *checkpoint = nullptr);
+
 
+    /// Computes the spectrum from pre-assembled matrices.
+    /**
+     * Only forms the Hamiltonian from the matrices in `hamiltonian` and diagonalises it,
+     * so this is much cheaper than assembling the Hamiltonian from scratch
+     * when computing spectra for many parameters.
+     * \param hamiltonian Terms of the Hamiltonian in each sector.
+     * \param parameters Parameters of the Hamiltonian.
+     * \param solver Algorithm to diagonalise the Hamiltonian in each sector with.
+     * \param lanczosSettings Parameters for Eigensolver::lanczos, ignored otherwise.
+     * \return A new instance of Spectrum-
+     */
+    static Spectrum compute(SplitHamiltonian const &hamiltonian,
+                            HubbardParameters const &parameters,
+                            Eigensolver solver = Eigensolver::dense,
+                            LanczosSettings const &lanczosSettings = {});
+
+
+    /// Reassemble a spectrum from previously computed eigenstates.
+    /**
+     * Charges and `basisIndex` are reconstructed, all other members are taken as given.
+     * \param inBasis Basis states ordered by sectors.
+     * \param parameters Parameters of the Hamiltonian.
+     * \param sectors Sectors of basis and eigenstates.
+     * \param energies Energy of each eigenstate.
+     * \param eigenStateIdxs Indexes of eigenstates into the basis.
+     * \param eigenStateCoeffs Coefficients of eigenstates.
+     * \throws std::invalid_argument if the sizes of the arguments are inconsistent.
+     * \return A new instance of Spectrum.
+     */
+    static Spectrum fromEigenstates(SumState inBasis, HubbardParameters const &parameters,
+                                    std::vector<Sector> sectors, DVector energies,
+                                    std::vector<std::vector<std::size_t>> eigenStateIdxs,
+                                    std::vector<std::vector<double>> eigenStateCoeffs);
 
     /// Return the number of eigenstates.
     [[nodiscard]] std::size_t size() const noexcept;
@@ -59,19 +224,77 @@ struct Spectrum
 
 private:
     /// Disallow construction from the outside.
-    explicit Spectrum(SumState const &inBasis);
+    explicit Spectrum(SumState inBasis);
 };
 
 
+/**
+ * Compute spectra for several parameters and call `process(p, spectrum)` with the
+ * spectrum for `parameters[p]`.
+ *
+ * If there are at least as many parameters as threads, they are processed concurrently
+ * with one thread each and `process` is called concurrently as well.
+ * Otherwise, they are processed one after the other with all threads used for each.
+ * Spectra are discarded after `process` returns.
+ */
+void forEachSpectrum(SplitHamiltonian const &hamiltonian,
+                     std::vector<HubbardParameters> const &parameters,
+                     Eigensolver solver, LanczosSettings const &lanczosSettings,
+                     std::function<void(std::size_t, Spectrum const &)> const &process);
+
+
+/**
+ * Turn matrix elements of an operator in basis `spectrum.basis`
+ * into matrix elements in the basis of eigenvectors.
+ *
+ * Computes \f$ V_{Q'}^T A_{Q'Q} V_Q \f$ for every pair of sectors \f$ Q', Q \f$
+ * that `matrix` couples where \f$ V_Q \f$ holds the eigenvectors of sector \f$ Q \f$.
+ * \param matrix Sparse matrix elements in `spectrum.basis`.
+ * \param spectrum Provides basis and eigenstates.
+ * \return Matrix elements in eigenbasis with one block per coupled pair of sectors.
+ */
+BlockSparseMatrix toEigenspaceMatrix(DSparseMatrix const &matrix, Spectrum const &spectrum);
+
 
 /**
  * Turn matrix elements of an operator in basis `spectrum.basis`
  * into matrix elements in the basis of eigenvectors.
  * \param matrix Matrix elements in `spectrum.basis`.
  * \param spectrum Provides basis and eigenstates.
- * \return Matrix elements in eigenbasis.
+ * \return Matrix elements in eigenbasis with one block per coupled pair of sectors.
+ */
+BlockSparseMatrix toEigenspaceMatrix(DMatrix const &matrix, Spectrum const &spectrum);
+
+
+/**
+ * Compute matrix elements of the particle annihilators on all sites in the basis of eigenvectors.
+ *
+ * Equivalent to `toEigenspaceMatrix(ParticleAnnihilator{i}, spectrum)` for every site `i`
+ * but never assembles the annihilators in `spectrum.basis`.
+ * Instead, annihilators are applied to the basis states of each sector directly
+ * and the eigenvectors of each coupled pair of sectors are assembled once for all sites.
+ * \param spectrum Provides basis and eigenstates.
+ * \return \f$ \langle\alpha|a_i|\gamma\rangle \f$ for each site `i`.
  */
-DSparseMatrix toEigenspaceMatrix(DMatrix const &matrix, Spectrum const &spectrum);
+std::vector<BlockSparseMatrix> particleAnnihilatorEigenspaceMatrices(Spectrum const &spectrum);
+
+
+/**
+ * Compute matrix elements of an operator in the basis of eigenvectors.
+ *
+ * Assembles the sparse matrix of the operator in `spectrum.basis`
+ * using `spectrum.basisIndex` and transforms it into the eigenbasis.
+ *
+ * \param op %Operator \f$ O \f$.
+ * \param spectrum Provides basis and eigenstates.
+ * \return \f$ O^{\alpha\gamma} = \langle\alpha|O|\gamma\rangle \f$
+ */
+template <typename T>
+BlockSparseMatrix toEigenspaceMatrix(Operator<T> const &op, Spectrum const &spectrum)
+{
+    return toEigenspaceMatrix(toSparseMatrix(op, spectrum.basis, spectrum.basisIndex),
+                              spectrum);
+}
 
 
 #endif //EXACT_HUBBARD_SPECTRUM_HPP
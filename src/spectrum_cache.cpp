@@ -0,0 +1,93 @@
+#include "spectrum_cache.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <utility>
+
+#include "hash.hpp"
+#include "io.hpp"
+#include "lattice.hpp"
+
+
+SpectrumCache::SpectrumCache(fs::path directory)
+        : directory_{std::move(directory)}
+{
+    fs::create_directories(directory_);
+}
+
+
+std::string SpectrumCache::key(LatticeSymmetry const &symmetry,
+                               HubbardParameters const &parameters,
+                               Eigensolver const solver,
+                               LanczosSettings const &lanczosSettings,
+                               std::size_t const maxCharge)
+{
+    Hasher hasher;
+    hasher.add(std::uint64_t{cacheVersion});
+    hasher.add(std::uint64_t{State::numWords});
+
+    auto const &lat = lattice();
+    hasher.add(std::uint64_t{lat.numSites()});
+    hasher.add(std::uint64_t{lat.links().size()});
+    for (std::size_t l = 0; l < lat.links().size(); ++l) {
+        hasher.add(std::uint64_t{lat.links()[l].first});
+        hasher.add(std::uint64_t{lat.links()[l].second});
+        hasher.add(lat.hoppings()[l]);
+    }
+    // all charges above the number of sites select the full fockspace
+    hasher.add(std::uint64_t{std::min(maxCharge, lat.numSites())});
+
+    // The symmetry determines the choice of eigenvectors in degenerate subspaces.
+    hasher.add(std::uint64_t{symmetry.order()});
+    for (auto const &element : symmetry.elements()) {
+        for (auto const x : element) {
+            hasher.add(std::uint64_t{x});
+        }
+    }
+
+    hasher.add(parameters.U);
+    hasher.add(parameters.kappa);
+
+    hasher.add(std::uint64_t{static_cast<unsigned>(solver)});
+    if (solver == Eigensolver::lanczos) {
+        hasher.add(lanczosSettings.boltzmannCutoff);
+        hasher.add(lanczosSettings.beta);
+        hasher.add(std::uint64_t{lanczosSettings.maxEigenpairs});
+        hasher.add(std::uint64_t{lanczosSettings.blockSize});
+        hasher.add(lanczosSettings.tolerance);
+        hasher.add(std::uint64_t{lanczosSettings.maxRestarts});
+        hasher.add(std::uint64_t{lanczosSettings.denseThreshold});
+    }
+
+    return hasher.hexDigest();
+}
+
+
+fs::path SpectrumCache::file(std::string const &key) const
+{
+    return directory_ / ("spectrum_" + key + ".bin");
+}
+
+
+std::optional<Spectrum> SpectrumCache::load(std::string const &key) const
+{
+    auto const fname = file(key);
+    if (not fs::exists(fname)) {
+        return std::nullopt;
+    }
+    try {
+        return loadSpectrumBinary(fname);
+    }
+    catch (std::runtime_error const &) {
+        return std::nullopt;
+    }
+}
+
+
+void SpectrumCache::store(std::string const &key, Spectrum const &spectrum) const
+{
+    writeAtomically(file(key), [&spectrum](fs::path const &fname) {
+        saveSpectrumBinary(fname, spectrum, true);
+    });
+}
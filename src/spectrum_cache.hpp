@@ -0,0 +1,74 @@
+#ifndef EXACT_HUBBARD_SPECTRUM_CACHE_HPP
+#define EXACT_HUBBARD_SPECTRUM_CACHE_HPP
+
+/** \file
+ * \brief On-disk cache of spectra.
+ */
+
+#include <filesystem>
+#include <optional>
+#include <string>
+
+#include "lanczos.hpp"
+#include "spectrum.hpp"
+#include "symmetry.hpp"
+
+namespace fs = std::filesystem;
+
+
+/**
+ * Directory of spectra of the Hamiltonian in the full Fock space.
+ *
+ * Spectra are stored in the binary format of saveSpectrumBinary including eigenvectors
+ * under a name derived from a hash of everything they depend on:
+ * lattice(), the symmetry group, U, kappa, the eigensolver and its settings,
+ * and cacheVersion.
+ * They are only valid for the basis fockspaceBasis() with the given maximum charge.
+ */
+class SpectrumCache
+{
+public:
+    /**
+     * Version of the layout of cached spectra, i.e. the ordering of basis states,
+     * sectors, and eigenstates.
+     * Must be incremented whenever the layout produced by Spectrum::compute changes.
+     */
+    static constexpr unsigned cacheVersion = 2;
+
+
+    /// Use a given directory, creates it if it does not exist.
+    explicit SpectrumCache(fs::path directory);
+
+
+    /// Compute the key of a spectrum for the basis `fockspaceBasis(maxCharge)`.
+    [[nodiscard]] static std::string key(LatticeSymmetry const &symmetry,
+                                         HubbardParameters const &parameters,
+                                         Eigensolver solver,
+                                         LanczosSettings const &lanczosSettings,
+                                         std::size_t maxCharge = maxNumSites);
+
+
+    /// Return the file that stores the spectrum with a given key.
+    [[nodiscard]] fs::path file(std::string const &key) const;
+
+
+    /// Load a spectrum if it is in the cache.
+    /**
+     * Files that cannot be read are treated as missing.
+     */
+    [[nodiscard]] std::optional<Spectrum> load(std::string const &key) const;
+
+
+    /// Store a spectrum.
+    /**
+     * Writes a temporary file and renames it, so concurrent readers never see
+     * incomplete files.
+     */
+    void store(std::string const &key, Spectrum const &spectrum) const;
+
+
+private:
+    fs::path directory_;
+};
+
+#endif //EXACT_HUBBARD_SPECTRUM_CACHE_HPP
@@ -1,87 +1,437 @@
 #include "state.hpp"
 
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
 #include <optional>
+#include <stdexcept>
+#include <utility>
+
+#include "config_tables.hpp"
 
 
 namespace {
-    /// Erase an elements from a std::vector.
-    template <typename T>
-    void erase(std::vector<T> &vec, std::size_t const i)
+    /// Terms with coefficients up to this magnitude are removed when compressing.
+    constexpr double cancellationThreshold = 1e-13;
+
+
+    /// Return the smallest power of 2 that is at least twice `n`, i.e. a table at most half full.
+    std::size_t tableSizeFor(std::size_t const n) noexcept
     {
-        vec.erase(vec.cbegin()
-                  + static_cast<typename decltype(vec.cbegin())::difference_type>(i));
+        std::size_t size = 16;
+        while (size < 2 * n) {
+            size *= 2;
+        }
+        return size;
+    }
+
+
+    /**
+     * Find the slot of a state in an open addressing table of indices into `states`.
+     * \return The slot that holds the index of `state` plus 1
+     *         or the empty slot where it should be inserted.
+     */
+    std::size_t &findSlot(std::vector<std::size_t> &table, State const *const states,
+                          State const &state) noexcept
+    {
+        std::size_t const mask = table.size() - 1;
+        for (std::size_t slot = state.hash() & mask; ; slot = (slot + 1) & mask) {
+            if (table[slot] == 0 or states[table[slot] - 1] == state) {
+                return table[slot];
+            }
+        }
     }
 }
 
 
 void SumState::compress()
 {
-    for (std::size_t i = 0; i < coefs_.size(); ++i) {
-        // Join elements with the same state.
-        // Compare state i with all states j > i.
-        // All states k < i are already unique.
-        for (std::size_t j = coefs_.size()-1; j > i; --j) {
-            if (states_[i] == states_[j]) {
-                coefs_[i] += coefs_[j];
-                erase(coefs_, j);
-                erase(states_, j);
-                // no need to modify j here as only elements k > j shift when erasing
-            }
+    // Move every first occurrence of a state to the front and add later ones to it.
+    std::vector<std::size_t> table(tableSizeFor(size()), 0);
+    std::size_t numUnique = 0;
+    for (std::size_t i = 0; i < size(); ++i) {
+        std::size_t &slot = findSlot(table, states_.data(), states_[i]);
+        if (slot == 0) {
+            states_[numUnique] = states_[i];
+            coefs_[numUnique] = coefs_[i];
+            slot = ++numUnique;
+        }
+        else {
+            coefs_[slot - 1] += coefs_[i];
         }
+    }
 
-        // erase elements with coefficient 0 from cancellation
-        if (std::abs(coefs_[i]) < 1e-13) {
-            erase(coefs_, i);
-            erase(states_, i);
-            --i;  // check the new element at this position next (elements have been shifted)
+    // erase elements with coefficient 0 from cancellation
+    std::size_t numKept = 0;
+    for (std::size_t i = 0; i < numUnique; ++i) {
+        if (std::abs(coefs_[i]) >= cancellationThreshold) {
+            states_[numKept] = states_[i];
+            coefs_[numKept] = coefs_[i];
+            ++numKept;
         }
     }
+    states_.resize(numKept);
+    coefs_.resize(numKept);
+}
+
+
+void SumState::canonicalize()
+{
+    if (canonical_) {
+        return;
+    }
+
+    compress();
+    std::vector<std::size_t> order(size());
+    std::iota(order.begin(), order.end(), std::size_t{0});
+    std::sort(order.begin(), order.end(), [this](std::size_t const a, std::size_t const b) {
+        return states_[a] < states_[b];
+    });
+
+    std::vector<double> coefs(size());
+    std::vector<State> states(size());
+    for (std::size_t i = 0; i < size(); ++i) {
+        coefs[i] = coefs_[order[i]];
+        states[i] = states_[order[i]];
+    }
+    coefs_ = std::move(coefs);
+    states_ = std::move(states);
+    canonical_ = true;
 }
 
+
 namespace {
-    // move a PH along the chain n -> p -> h -> ph -> n
-    constexpr std::optional<PH> increment(PH ph) noexcept
+    /// Return `sumState` if it is canonical or a canonical copy of it stored in `storage`.
+    SumState const &canonicalOf(SumState const &sumState, SumState &storage)
     {
-        if (ph == PH::ph) {
-            return {};
+        if (sumState.isCanonical()) {
+            return sumState;
         }
+        storage = sumState;
+        storage.canonicalize();
+        return storage;
+    }
+}
+
 
-        return PH{underlying(ph) + 1};
+double dot(SumState const &a, SumState const &b)
+{
+    SumState storageA;
+    SumState storageB;
+    auto const &ca = canonicalOf(a, storageA);
+    auto const &cb = canonicalOf(b, storageB);
+
+    double res = 0.0;
+    State const *const statesA = ca.states();
+    State const *const statesB = cb.states();
+    for (std::size_t i = 0, j = 0; i < ca.size() and j < cb.size();) {
+        if (statesA[i] < statesB[j]) {
+            ++i;
+        }
+        else if (statesB[j] < statesA[i]) {
+            ++j;
+        }
+        else {
+            res += ca[i].first * cb[j].first;
+            ++i;
+            ++j;
+        }
     }
+    return res;
+}
 
 
-    // increment the PH in a state at site dim
-    [[nodiscard]] constexpr bool increment(State &state, size_t const dim = 0) noexcept
-    {
-        auto const inc = increment(state[dim]);
-        if (inc.has_value()) {
-            state[dim] = *inc;
-            return true;
+SumState add(SumState const &a, SumState const &b, double const factor)
+{
+    SumState storageA;
+    SumState storageB;
+    auto const &ca = canonicalOf(a, storageA);
+    auto const &cb = canonicalOf(b, storageB);
+
+    SumState res;
+    res.reserve(ca.size() + cb.size());
+    auto const push = [&res](double const coef, State const &state) {
+        if (std::abs(coef) >= cancellationThreshold) {
+            res.push(coef, state);
+        }
+    };
+
+    State const *const statesA = ca.states();
+    State const *const statesB = cb.states();
+    std::size_t i = 0;
+    std::size_t j = 0;
+    while (i < ca.size() and j < cb.size()) {
+        if (statesA[i] < statesB[j]) {
+            push(ca[i].first, statesA[i]);
+            ++i;
+        }
+        else if (statesB[j] < statesA[i]) {
+            push(factor * cb[j].first, statesB[j]);
+            ++j;
         }
         else {
-            state[dim] = PH::n;
-            if (dim == state.size()-1) {
-                return false;
+            push(ca[i].first + factor * cb[j].first, statesA[i]);
+            ++i;
+            ++j;
+        }
+    }
+    for (; i < ca.size(); ++i) {
+        push(ca[i].first, statesA[i]);
+    }
+    for (; j < cb.size(); ++j) {
+        push(factor * cb[j].first, statesB[j]);
+    }
+    return res;
+}
+
+
+namespace {
+    /// SumStates that are not in use by any ScratchSumState.
+    std::vector<SumState> &scratchPool()
+    {
+        thread_local std::vector<SumState> pool;
+        return pool;
+    }
+}
+
+
+ScratchSumState::ScratchSumState(std::size_t const capacity)
+{
+    auto &pool = scratchPool();
+    if (not pool.empty()) {
+        sumState_ = std::move(pool.back());
+        pool.pop_back();
+    }
+    sumState_.clear();
+    sumState_.reserve(capacity);
+}
+
+
+ScratchSumState::~ScratchSumState()
+{
+    try {
+        scratchPool().push_back(std::move(sumState_));
+    }
+    catch (...) {
+        // cannot keep the storage around, just let it be freed
+    }
+}
+
+
+SumStateAccumulator::SumStateAccumulator(std::size_t const expectedSize)
+        : table_(tableSizeFor(expectedSize), 0)
+{
+    sum_.reserve(expectedSize);
+}
+
+
+void SumStateAccumulator::add(double const coef, State const &state)
+{
+    std::size_t &slot = findSlot(table_, std::as_const(sum_).states(), state);
+    if (slot != 0) {
+        sum_[slot - 1].first += coef;
+        return;
+    }
+
+    sum_.push(coef, state);
+    slot = sum_.size();
+    if (2 * sum_.size() > table_.size()) {
+        rehash(2 * table_.size());
+    }
+}
+
+
+void SumStateAccumulator::add(SumState const &states, double const factor)
+{
+    for (std::size_t i = 0; i < states.size(); ++i) {
+        auto const [coef, state] = states[i];
+        add(factor * coef, state);
+    }
+}
+
+
+SumState SumStateAccumulator::finish()
+{
+    SumState res;
+    res.reserve(sum_.size());
+    for (std::size_t i = 0; i < sum_.size(); ++i) {
+        auto const [coef, state] = std::as_const(sum_)[i];
+        if (std::abs(coef) >= cancellationThreshold) {
+            res.push(coef, state);
+        }
+    }
+    sum_.clear();
+    std::fill(table_.begin(), table_.end(), 0);
+    return res;
+}
+
+
+void SumStateAccumulator::rehash(std::size_t const tableSize)
+{
+    table_.assign(tableSize, 0);
+    for (std::size_t i = 0; i < sum_.size(); ++i) {
+        findSlot(table_, std::as_const(sum_).states(), std::as_const(sum_)[i].second) = i + 1;
+    }
+}
+
+
+namespace {
+    static_assert(maxNumSites <= 64, "Site masks must fit into a 64-bit integer");
+
+
+    /**
+     * Construct all states with `count` particles (or holes if `holes` is `true`)
+     * and no other occupation, in order of increasing bit masks of occupied sites.
+     */
+    std::vector<State> occupations(std::size_t const numSites, std::size_t const count,
+                                   bool const holes)
+    {
+        std::vector<State> res;
+        if (count > numSites) {
+            return res;
+        }
+        if (count == 0) {
+            res.emplace_back();
+            return res;
+        }
+
+        // start with the lowest `count` sites occupied
+        std::uint64_t const lowestSites = ~std::uint64_t{0} >> (64 - count);
+        for (std::uint64_t mask = lowestSites; ; mask = nextCombination(mask)) {
+            State state;
+            for (std::size_t site = 0; site < numSites; ++site) {
+                if ((mask >> site) & 1) {
+                    if (holes) {
+                        state.addHoleOn(site);
+                    }
+                    else {
+                        state.addParticleOn(site);
+                    }
+                }
+            }
+            res.push_back(state);
+
+            // stop after the highest `count` sites are occupied
+            if (mask >> (numSites - count) == lowestSites) {
+                break;
+            }
+        }
+        return res;
+    }
+
+
+    /// Return the number of states with given numbers of particles and holes on lattice().
+    std::size_t sectorSize(int const numParticles, int const numHoles) noexcept
+    {
+        if (numParticles < 0 or numHoles < 0) {
+            return 0;
+        }
+        std::size_t const numSites = lattice().numSites();
+#ifdef EXACT_HUBBARD_CONSTEXPR_TABLES
+        if (numSites == NSITES and numParticles <= static_cast<int>(NSITES)
+            and numHoles <= static_cast<int>(NSITES)) {
+            return configSectorSizes[configSectorIndex(static_cast<std::size_t>(numParticles),
+                                                       static_cast<std::size_t>(numHoles))];
+        }
+#endif
+        return binomial(numSites, static_cast<std::size_t>(numParticles))
+               * binomial(numSites, static_cast<std::size_t>(numHoles));
+    }
+
+
+    /// Append all states with given numbers of particles and holes to `basis`.
+    void appendSector(SumState &basis, int const numParticles, int const numHoles)
+    {
+        std::size_t const numSites = lattice().numSites();
+        if (numParticles < 0 or numHoles < 0) {
+            return;
+        }
+#ifdef EXACT_HUBBARD_CONSTEXPR_TABLES
+        if constexpr (haveConfigBasis) {
+            if (numSites == NSITES and numParticles <= static_cast<int>(NSITES)
+                and numHoles <= static_cast<int>(NSITES)) {
+                auto const sector = configSectorIndex(static_cast<std::size_t>(numParticles),
+                                                      static_cast<std::size_t>(numHoles));
+                for (std::size_t i = configSectorOffsets[sector];
+                     i < configSectorOffsets[sector + 1]; ++i) {
+                    basis.push(1.0, State{configBasis[i]});
+                }
+                return;
+            }
+        }
+#endif
+        auto const particles = occupations(numSites, static_cast<std::size_t>(numParticles),
+                                           false);
+        auto const holes = occupations(numSites, static_cast<std::size_t>(numHoles), true);
+
+        for (auto const &particleState : particles) {
+            for (auto const &holeState : holes) {
+                State::Words words{};
+                for (std::size_t w = 0; w < State::numWords; ++w) {
+                    words[w] = particleState.words()[w] | holeState.words()[w];
+                }
+                basis.push(1.0, State{words});
             }
-            return increment(state, dim+1);
         }
     }
 }
 
 
-SumState fockspaceBasis()
+SumState fockspaceSector(int const numParticles, int const numHoles)
 {
     SumState basis;
-    State auxState;
-    basis.push(1.0, auxState);
+    basis.reserve(sectorSize(numParticles, numHoles));
+    appendSector(basis, numParticles, numHoles);
+    return basis;
+}
+
 
-    // go through all possible permutations
-    while (true) {
-        if (not increment(auxState)) {
-            break;
+SumState fockspaceChargeSector(int const charge)
+{
+    int const numSites = static_cast<int>(lattice().numSites());
+    std::size_t size = 0;
+    for (int numParticles = std::max(charge, 0); numParticles <= numSites; ++numParticles) {
+        size += sectorSize(numParticles, numParticles - charge);
+    }
+
+    SumState basis;
+    basis.reserve(size);
+    for (int numParticles = std::max(charge, 0); numParticles <= numSites; ++numParticles) {
+        appendSector(basis, numParticles, numParticles - charge);
+    }
+    return basis;
+}
+
+
+SumState fockspaceBasis(std::size_t const maxCharge)
+{
+    int const numSites = static_cast<int>(lattice().numSites());
+    auto const included = [maxCharge](int const numParticles, int const numHoles) {
+        return static_cast<std::size_t>(std::abs(numParticles - numHoles)) <= maxCharge;
+    };
+
+    std::size_t size = 0;
+    for (int numParticles = 0; numParticles <= numSites; ++numParticles) {
+        for (int numHoles = 0; numHoles <= numSites; ++numHoles) {
+            if (included(numParticles, numHoles)) {
+                auto const n = sectorSize(numParticles, numHoles);
+                if (n > std::numeric_limits<std::size_t>::max() - size) {
+                    throw std::length_error("The basis has too many states");
+                }
+                size += n;
+            }
         }
-        basis.push(1.0, auxState);
     }
 
+    SumState basis;
+    basis.reserve(size);
+    for (int numParticles = 0; numParticles <= numSites; ++numParticles) {
+        for (int numHoles = 0; numHoles <= numSites; ++numHoles) {
+            if (included(numParticles, numHoles)) {
+                appendSector(basis, numParticles, numHoles);
+            }
+        }
+    }
     return basis;
 }
@@ -6,11 +6,15 @@
  */
 
 #include <array>
+#include <atomic>
 #include <cassert>
+#include <cstdint>
+#include <functional>
 #include <type_traits>
 #include <vector>
 
 #include "config.hpp"
+#include "lattice.hpp"
 
 
 /// Indicate the presence of particles and holes at a lattice site.
@@ -51,20 +55,98 @@ constexpr PH operator~(PH const ph) noexcept
 }
 
 
+/// Count the number of set bits in a word.
+constexpr int popcount(std::uint64_t const word) noexcept
+{
+#if defined __GNUG__
+    static_assert(std::is_same_v<std::uint64_t, unsigned long>
+                  or std::is_same_v<std::uint64_t, unsigned long long>);
+    return __builtin_popcountll(word);
+#else
+    // count manually
+    int count = 0;
+    for (std::uint64_t w = word; w != 0; w &= w - 1) {
+        ++count;
+    }
+    return count;
+#endif
+}
+
+
+/// Return the next larger integer with the same number of set bits (Gosper's hack).
+constexpr std::uint64_t nextCombination(std::uint64_t const mask) noexcept
+{
+    std::uint64_t const lowest = mask & (~mask + 1);
+    std::uint64_t const ripple = mask + lowest;
+    return ripple | (((ripple ^ mask) / lowest) >> 2);
+}
+
+
+/// Return the number of ways to choose k out of n elements.
+constexpr std::size_t binomial(std::size_t const n, std::size_t const k) noexcept
+{
+    if (k > n) {
+        return 0;
+    }
+    std::size_t res = 1;
+    for (std::size_t i = 1; i <= (k < n - k ? k : n - k); ++i) {
+        res = res * (n - i + 1) / i;  // exact because res is C(n, i-1) * (n-i+1)
+    }
+    return res;
+}
+
+
 /**
- * Store PH values for all NSITES lattice sites.
+ * Store PH values for all lattice sites.
+ *
+ * Every site occupies two adjacent bits, the lower one for the particle
+ * and the upper one for the hole, i.e. the bits of site `i` are `2*i` and `2*i+1`
+ * and hold the value of the corresponding PH.
+ * Sites are packed into as few 64-bit words as possible for maxNumSites sites,
+ * bits of sites beyond the number of sites of lattice() are always zero.
+ * The bit ordering coincides with the ordering of creation operators,
+ * so fermionic signs can be computed by counting the set bits before a given bit.
  */
 class State
 {
-    std::array<PH, NSITES> sites_{};
+public:
+    /// Type of the words that store the bits.
+    using Word = std::uint64_t;
+
+    /// Number of bits used to encode a single site.
+    constexpr static std::size_t bitsPerSite = 2;
+    /// Number of bits in a single word.
+    constexpr static std::size_t bitsPerWord = 64;
+    /// Number of sites stored in a single word.
+    constexpr static std::size_t sitesPerWord = bitsPerWord / bitsPerSite;
+    /// Number of words needed to store all sites.
+    constexpr static std::size_t numWords = (maxNumSites + sitesPerWord - 1) / sitesPerWord;
+
+    /// Bits of all particles in a word.
+    constexpr static Word particleMask = 0x5555'5555'5555'5555;
+    /// Bits of all holes in a word.
+    constexpr static Word holeMask = 0xaaaa'aaaa'aaaa'aaaa;
+
+    /// Storage type for all words of a state.
+    using Words = std::array<Word, numWords>;
+
+
+    /// Construct the empty state.
+    constexpr State() noexcept = default;
+
+
+    /// Construct from raw words, bits beyond the last site must not be set.
+    explicit constexpr State(Words const &words) noexcept : words_{words}
+    {
+        assert((words_[numWords-1] & ~usedBitsMask(numWords-1, maxNumSites)) == 0);
+    }
 
 
-public:
     /// Return `true` iff *all* sites are equal.
     constexpr bool operator==(State const &other) const noexcept
     {
-        for (std::size_t i = 0; i < size(); ++i) {
-            if (sites_[i] != other.sites_[i]) {
+        for (std::size_t w = 0; w < numWords; ++w) {
+            if (words_[w] != other.words_[w]) {
                 return false;
             }
         }
@@ -72,93 +154,245 @@ public:
     }
 
 
-    /// Return number of alttice sites.
-    [[nodiscard]] constexpr std::size_t size() const noexcept
+    /// Return `true` iff *any* sites differ.
+    constexpr bool operator!=(State const &other) const noexcept
     {
-        return sites_.size();
+        return not (*this == other);
     }
 
 
-    /// Access PH value at a site.
-    constexpr PH &operator[](std::size_t const site) noexcept
+    /// Order states by their words as one integer where the last word is the most significant.
+    constexpr bool operator<(State const &other) const noexcept
+    {
+        for (std::size_t w = numWords; w > 0; --w) {
+            if (words_[w-1] != other.words_[w-1]) {
+                return words_[w-1] < other.words_[w-1];
+            }
+        }
+        return false;
+    }
+
+
+    /// Return number of lattice sites.
+    [[nodiscard]] std::size_t size() const
+    {
+        return lattice().numSites();
+    }
+
+
+    /// Access the raw words.
+    [[nodiscard]] constexpr Words const &words() const noexcept
     {
-        assert(site < sites_.size());
-        return sites_[site];
+        return words_;
     }
 
 
     /// Access PH value at a site.
     constexpr PH operator[](std::size_t const site) const noexcept
     {
-        assert(site < sites_.size());
-        return sites_[site];
+        assert(site < maxNumSites);
+        return PH{static_cast<std::underlying_type_t<PH>>(
+                (words_[wordIndex(2*site)] >> bitIndex(2*site)) & 0b11)};
+    }
+
+
+    /// Set the PH value at a site.
+    constexpr void set(std::size_t const site, PH const ph) noexcept
+    {
+        assert(site < maxNumSites);
+        Word &word = words_[wordIndex(2*site)];
+        word = (word & ~(Word{0b11} << bitIndex(2*site)))
+               | (Word{underlying(ph)} << bitIndex(2*site));
     }
 
 
     /// Return `true` if there is a particle on a site.
     [[nodiscard]] constexpr bool hasParticleOn(std::size_t const site) const noexcept
     {
-        assert(site < sites_.size());
-        return underlying(sites_[site] & PH::p) != 0;
+        assert(site < maxNumSites);
+        return testBit(2*site);
     }
 
 
-    /// Return `true` if there is a heol on a site.
+    /// Return `true` if there is a hole on a site.
     [[nodiscard]] constexpr bool hasHoleOn(std::size_t const site) const noexcept
     {
-        assert(site < sites_.size());
-        return underlying(sites_[site] & PH::h) != 0;
+        assert(site < maxNumSites);
+        return testBit(2*site + 1);
     }
 
 
     /// Return the number of particles+holes on a site.
     [[nodiscard]] constexpr int numberOn(std::size_t const site) const noexcept
     {
-        assert(site < sites_.size());
-#if defined __GNUG__
-        // count number of set bits if possible
-        static_assert(std::is_same_v<std::underlying_type_t<PH>, unsigned int>);
-        return __builtin_popcount(underlying(sites_[site]));
-#else
-        // count manually (does not get optimised to popcount automatically)
-        return static_cast<int>(hasParticleOn(site)) + static_cast<int>(hasHoleOn(site));
-#endif
+        assert(site < maxNumSites);
+        return popcount(words_[wordIndex(2*site)] & (Word{0b11} << bitIndex(2*site)));
+    }
+
+
+    /// Return the number of particles+holes on all sites before and excluding the given site.
+    [[nodiscard]] constexpr int numberBefore(std::size_t const site) const noexcept
+    {
+        assert(site < maxNumSites);
+        return countBitsBefore(2*site);
+    }
+
+
+    /**
+     * Return the number of set bits before and excluding a given bit.
+     * \param bit Index of the bit, `2*site` for particles and `2*site+1` for holes.
+     */
+    [[nodiscard]] constexpr int countBitsBefore(std::size_t const bit) const noexcept
+    {
+        assert(bit < bitsPerSite*maxNumSites);
+        int count = 0;
+        for (std::size_t w = 0; w < wordIndex(bit); ++w) {
+            count += popcount(words_[w]);
+        }
+        return count + popcount(words_[wordIndex(bit)] & ((Word{1} << bitIndex(bit)) - 1));
+    }
+
+
+    /// Return the total number of particles.
+    [[nodiscard]] constexpr int numParticles() const noexcept
+    {
+        int count = 0;
+        for (auto const word : words_) {
+            count += popcount(word & particleMask);
+        }
+        return count;
+    }
+
+
+    /// Return the total number of holes.
+    [[nodiscard]] constexpr int numHoles() const noexcept
+    {
+        int count = 0;
+        for (auto const word : words_) {
+            count += popcount(word & holeMask);
+        }
+        return count;
+    }
+
+
+    /// Return the number of sites with either a particle or a hole but not both.
+    [[nodiscard]] constexpr int numChargedSites() const noexcept
+    {
+        int count = 0;
+        for (auto const word : words_) {
+            count += popcount((word ^ (word >> 1)) & particleMask);
+        }
+        return count;
     }
 
 
     /// Make it so there is a particle at a site regardless of whether there was one already.
     constexpr void addParticleOn(std::size_t const site) noexcept
     {
-        assert(site < sites_.size());
-        sites_[site] = sites_[site] | PH::p;
+        assert(site < maxNumSites);
+        setBit(2*site);
     }
 
 
     /// Make it so there is no particle at a site regardless of whether there was one in the first place.
     constexpr void removeParticleOn(std::size_t const site) noexcept
     {
-        assert(site < sites_.size());
-        sites_[site] = sites_[site] &~ PH::p;
+        assert(site < maxNumSites);
+        clearBit(2*site);
     }
 
 
     /// Make it so there is a hole at a site regardless of whether there was one already.
     constexpr void addHoleOn(std::size_t const site) noexcept {
-        assert(site < sites_.size());
-        sites_[site] = sites_[site] | PH::h;
+        assert(site < maxNumSites);
+        setBit(2*site + 1);
     }
 
 
     /// Make it so there is no hole at a site regardless of whether there was one in the first place.
     constexpr void removeHoleOn(std::size_t const site) noexcept {
-        assert(site < sites_.size());
-        sites_[site] = sites_[site] &~ PH::h;
+        assert(site < maxNumSites);
+        clearBit(2*site + 1);
+    }
+
+
+    /// Compute a hash of the state.
+    [[nodiscard]] constexpr std::size_t hash() const noexcept
+    {
+        // multiplicative mixing (Fibonacci hashing), good enough for open addressing
+        Word h = 0;
+        for (auto const word : words_) {
+            h = (h ^ word) * 0x9e37'79b9'7f4a'7c15;
+            h ^= h >> 32;
+        }
+        return h;
+    }
+
+
+    /// Return a mask of all bits in word `w` that are used to encode `numSites` sites.
+    [[nodiscard]] constexpr static Word usedBitsMask(std::size_t const w,
+                                                     std::size_t const numSites) noexcept
+    {
+        if (bitsPerSite*numSites <= w*bitsPerWord) {
+            return Word{0};
+        }
+        std::size_t const nbits = bitsPerSite*numSites - w*bitsPerWord;
+        return nbits >= bitsPerWord ? ~Word{0} : (Word{1} << nbits) - 1;
+    }
+
+
+private:
+    Words words_{};
+
+
+    /// Return the index of the word that contains a given bit.
+    [[nodiscard]] constexpr static std::size_t wordIndex(std::size_t const bit) noexcept
+    {
+        return bit / bitsPerWord;
+    }
+
+
+    /// Return the index of a bit inside of its word.
+    [[nodiscard]] constexpr static std::size_t bitIndex(std::size_t const bit) noexcept
+    {
+        return bit % bitsPerWord;
+    }
+
+
+    [[nodiscard]] constexpr bool testBit(std::size_t const bit) const noexcept
+    {
+        return ((words_[wordIndex(bit)] >> bitIndex(bit)) & Word{1}) != 0;
+    }
+
+
+    constexpr void setBit(std::size_t const bit) noexcept
+    {
+        words_[wordIndex(bit)] |= Word{1} << bitIndex(bit);
+    }
+
+
+    constexpr void clearBit(std::size_t const bit) noexcept
+    {
+        words_[wordIndex(bit)] &= ~(Word{1} << bitIndex(bit));
     }
 };
 
 
+namespace std {
+    /// Hash a State for use in unordered containers.
+    template <>
+    struct hash<State>
+    {
+        std::size_t operator()(State const &state) const noexcept
+        {
+            return state.hash();
+        }
+    };
+}
+
+
 /// Return the number of sites based on a state.
-constexpr std::size_t size(State const &state) noexcept
+inline std::size_t size(State const &state)
 {
     return state.size();
 }
@@ -171,20 +405,53 @@ constexpr double dot(State const &a, State const &b) noexcept
 }
 
 
+#ifndef NDEBUG
+/// Number of times the storage of any SumState has grown, only counted in debug builds.
+inline std::atomic<std::size_t> sumStateAllocationCounter{0};
+#endif
+
+
+/**
+ * Return the number of times the storage of any SumState has grown.
+ *
+ * Only counted in debug builds to make regressions in allocation free code visible,
+ * always returns 0 if NDEBUG is defined.
+ */
+inline std::size_t sumStateAllocations() noexcept
+{
+#ifndef NDEBUG
+    return sumStateAllocationCounter.load(std::memory_order_relaxed);
+#else
+    return 0;
+#endif
+}
+
+
 /**
  * Store multiple states and coefficients and represent them as their sum.
  *
  * Corresponds to sum_i sumState[i][0]*sumState[i][1].
+ *
+ * A SumState is *canonical* if its states are strictly increasing wrt. State::operator<,
+ * i.e. sorted and without duplicates.
+ * This is tracked with a flag such that dot products and sums of canonical SumStates
+ * can be computed by merging in linear time.
  */
 class SumState
 {
     std::vector<double> coefs_;
     std::vector<State> states_;
+    bool canonical_ = true;
 
 public:
     /// Reserve memory for n states.
     void reserve(std::size_t const n)
     {
+#ifndef NDEBUG
+        if (n > states_.capacity()) {
+            sumStateAllocationCounter.fetch_add(1, std::memory_order_relaxed);
+        }
+#endif
         coefs_.reserve(n);
         states_.reserve(n);
     }
@@ -197,8 +464,8 @@ public:
     }
 
 
-    /// Return coefficient and state number `i`.
-    std::pair<double&, State&> operator[](std::size_t const i) noexcept
+    /// Return coefficient and state number `i`, only the coefficient can be modified.
+    std::pair<double&, State const&> operator[](std::size_t const i) noexcept
     {
         return {coefs_[i], states_[i]};
     }
@@ -218,16 +485,23 @@ public:
     }
 
 
-    /// Access underlying state storage.
+    /// Access underlying state storage, the SumState is no longer considered canonical.
     [[nodiscard]] State *states() noexcept
     {
+        canonical_ = false;
         return states_.data();
     }
 
 
-    /// Append a new state.
+    /// Append a new state, remains canonical if `state` is greater than all stored states.
     void push(double const coef, State const &state)
     {
+        canonical_ = canonical_ and (states_.empty() or states_.back() < state);
+#ifndef NDEBUG
+        if (states_.size() == states_.capacity()) {
+            sumStateAllocationCounter.fetch_add(1, std::memory_order_relaxed);
+        }
+#endif
         states_.emplace_back(state);
         coefs_.push_back(coef);
     }
@@ -238,34 +512,184 @@ public:
     {
         coefs_.clear();
         states_.clear();
+        canonical_ = true;
     }
 
 
-    /// Remove duplicate states by adding up their coefficients.
+    /// Return `true` if the states are known to be sorted and unique.
+    [[nodiscard]] bool isCanonical() const noexcept
+    {
+        return canonical_;
+    }
+
+
+    /**
+     * Bring into canonical form.
+     *
+     * Compresses and sorts the states, does nothing if the SumState is already canonical.
+     */
+    void canonicalize();
+
+
+    /**
+     * Remove duplicate states by adding up their coefficients.
+     *
+     * Terms whose coefficients cancel are removed as well.
+     * The remaining terms keep the order of their first occurrence.
+     * Uses a hash table over states and runs in linear time.
+     */
     void compress();
 };
 
 
-/// Compute the dot product of two SumStates.
-inline double dot(SumState const &a, SumState const &b) noexcept
+/**
+ * A SumState borrowed from a pool of the current thread for use as a temporary buffer.
+ *
+ * The SumState is returned to the pool on destruction and handed out again with its
+ * storage intact, so operators can be applied repeatedly without allocating memory
+ * once the pool is warmed up.
+ * Instances can be nested, each one gets a separate SumState.
+ */
+class ScratchSumState
 {
-    double res = 0.0;
-    for (std::size_t i = 0; i < a.size(); ++i) {
-        auto const &[ca, sa] = a[i];
-        for (std::size_t j = 0; j < b.size(); ++j) {
-            auto const &[cb, sb] = b[j];
-            res += ca * cb * dot(sa, sb);
-        }
+public:
+    /// Borrow an empty SumState with room for at least `capacity` states.
+    explicit ScratchSumState(std::size_t capacity);
+
+    ~ScratchSumState();
+
+    ScratchSumState(ScratchSumState const &) = delete;
+    ScratchSumState &operator=(ScratchSumState const &) = delete;
+    ScratchSumState(ScratchSumState &&) = delete;
+    ScratchSumState &operator=(ScratchSumState &&) = delete;
+
+
+    /// Access the SumState.
+    [[nodiscard]] SumState &operator*() noexcept
+    {
+        return sumState_;
     }
-    return res;
+
+
+    /// Access the SumState.
+    [[nodiscard]] SumState *operator->() noexcept
+    {
+        return &sumState_;
+    }
+
+
+private:
+    SumState sumState_;
+};
+
+
+/**
+ * Build a SumState by adding terms and merging terms with equal states on the fly.
+ *
+ * Uses an open addressing hash table over states, so adding a term takes constant time
+ * on average and the accumulated sum never holds duplicates.
+ */
+class SumStateAccumulator
+{
+public:
+    /// Prepare for a given number of distinct states.
+    explicit SumStateAccumulator(std::size_t expectedSize = 0);
+
+
+    /// Add `coef * state`.
+    void add(double coef, State const &state);
+
+
+    /// Add `factor * states`.
+    void add(SumState const &states, double factor = 1.0);
+
+
+    /// Return the number of distinct states added so far.
+    [[nodiscard]] std::size_t size() const noexcept
+    {
+        return sum_.size();
+    }
+
+
+    /**
+     * Return the accumulated SumState with terms whose coefficients cancel removed.
+     * The terms are ordered by their first occurrence.
+     * Leaves the accumulator empty.
+     */
+    [[nodiscard]] SumState finish();
+
+
+private:
+    SumState sum_;
+    /// Open addressing table of indices into sum_ plus 1, 0 marks empty slots.
+    std::vector<std::size_t> table_;
+
+
+    void rehash(std::size_t tableSize);
+};
+
+
+/// Compute the dot product of two SumStates.
+/**
+ * Merges canonical SumStates in linear time.
+ * Otherwise, canonical copies are made first which takes O(n log n) time.
+ */
+double dot(SumState const &a, SumState const &b);
+
+
+/**
+ * Compute `a + factor*b`.
+ *
+ * Merges canonical SumStates in linear time.
+ * Otherwise, canonical copies are made first which takes O(n log n) time.
+ * \return A canonical SumState without terms whose coefficients cancel.
+ */
+SumState add(SumState const &a, SumState const &b, double factor = 1.0);
+
+
+/// Compute the sum of two SumStates, see add.
+inline SumState operator+(SumState const &a, SumState const &b)
+{
+    return add(a, b);
 }
 
 
+/// Compute the difference of two SumStates, see add.
+inline SumState operator-(SumState const &a, SumState const &b)
+{
+    return add(a, b, -1.0);
+}
+
+
+/**
+ * Construct the basis of a sector of the fockspace with fixed numbers of particles and holes.
+ *
+ * Enumerates combinations of occupied sites directly,
+ * so the cost is linear in the size of the sector and independent of the size of the fockspace.
+ * \return SumState containing basis vectors, empty if there are no states
+ *         with the given numbers on lattice().
+ *         All coefficients are `1.0`.
+ */
+SumState fockspaceSector(int numParticles, int numHoles);
+
+
+/**
+ * Construct the basis of all states with a given charge (#particles - #holes).
+ * \return SumState containing basis vectors ordered by number of particles.
+ *         All coefficients are `1.0`.
+ */
+SumState fockspaceChargeSector(int charge);
+
+
 /**
  * Construct the basis of the fockspace.
- * \return SumState containing basis vectors.
+ * \param maxCharge Only include sectors whose charge (#particles - #holes) has at most this
+ *                  magnitude. The default includes all sectors.
+ * \throws std::length_error if the basis has more than 2^64 states.
+ * \return SumState containing basis vectors ordered by number of particles
+ *         and then by number of holes, see fockspaceSector.
  *         All coefficients are `1.0`.
  */
-SumState fockspaceBasis();
+SumState fockspaceBasis(std::size_t maxCharge = maxNumSites);
 
 #endif //EXACT_HUBBARD_STATE_HPP
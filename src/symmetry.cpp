@@ -0,0 +1,370 @@
+#include "symmetry.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <limits>
+#include <set>
+#include <stdexcept>
+
+#include <blaze/math/lapack/syev.h>
+
+
+namespace {
+    /// Return the permutation that applies `b` first and `a` second.
+    SitePermutation compose(SitePermutation const &a, SitePermutation const &b)
+    {
+        SitePermutation res(b.size());
+        for (std::size_t x = 0; x < b.size(); ++x) {
+            res[x] = a[b[x]];
+        }
+        return res;
+    }
+
+
+    SitePermutation inverse(SitePermutation const &perm)
+    {
+        SitePermutation res(perm.size());
+        for (std::size_t x = 0; x < perm.size(); ++x) {
+            res[perm[x]] = x;
+        }
+        return res;
+    }
+
+
+    SitePermutation identity(std::size_t const numSites)
+    {
+        SitePermutation res(numSites);
+        for (std::size_t x = 0; x < numSites; ++x) {
+            res[x] = x;
+        }
+        return res;
+    }
+
+
+    /// Hopping weights between all pairs of sites, 0 if there is no link.
+    using Adjacency = std::vector<std::vector<double>>;
+
+    Adjacency adjacencyMatrix(Lattice const &lattice)
+    {
+        Adjacency adj(lattice.numSites(), std::vector<double>(lattice.numSites(), 0.0));
+        for (std::size_t l = 0; l < lattice.links().size(); ++l) {
+            auto const [a, b] = lattice.links()[l];
+            adj[a][b] = lattice.hoppings()[l];
+            adj[b][a] = lattice.hoppings()[l];
+        }
+        return adj;
+    }
+
+
+    /// Recursively assign images to sites and store every complete automorphism.
+    void extendAutomorphism(SitePermutation &perm, std::vector<bool> &used,
+                            std::size_t const site, Adjacency const &adj,
+                            std::vector<SitePermutation> &out)
+    {
+        if (site == perm.size()) {
+            out.push_back(perm);
+            return;
+        }
+
+        for (std::size_t target = 0; target < perm.size(); ++target) {
+            if (used[target]) {
+                continue;
+            }
+            // links to all previously assigned sites must be preserved
+            bool consistent = adj[site][site] == adj[target][target];
+            for (std::size_t prev = 0; prev < site and consistent; ++prev) {
+                consistent = adj[site][prev] == adj[target][perm[prev]];
+            }
+            if (not consistent) {
+                continue;
+            }
+
+            perm[site] = target;
+            used[target] = true;
+            extendAutomorphism(perm, used, site + 1, adj, out);
+            used[target] = false;
+        }
+    }
+
+
+    /// Return the first `n` prime numbers.
+    std::vector<std::size_t> firstPrimes(std::size_t const n)
+    {
+        std::vector<std::size_t> primes;
+        primes.reserve(n);
+        for (std::size_t candidate = 2; primes.size() < n; ++candidate) {
+            bool isPrime = true;
+            for (auto it = primes.begin(); it != primes.end() and *it * *it <= candidate; ++it) {
+                if (candidate % *it == 0) {
+                    isPrime = false;
+                    break;
+                }
+            }
+            if (isPrime) {
+                primes.push_back(candidate);
+            }
+        }
+        return primes;
+    }
+
+
+    /// Assign each element the index of its conjugacy class.
+    std::vector<std::size_t> conjugacyClasses(std::vector<SitePermutation> const &elements,
+                                              std::size_t &numClasses)
+    {
+        constexpr auto unassigned = std::numeric_limits<std::size_t>::max();
+        std::vector<std::size_t> classes(elements.size(), unassigned);
+        numClasses = 0;
+
+        for (std::size_t i = 0; i < elements.size(); ++i) {
+            if (classes[i] != unassigned) {
+                continue;
+            }
+            for (auto const &h : elements) {
+                auto const conjugate = compose(compose(h, elements[i]), inverse(h));
+                auto const it = std::find(elements.begin(), elements.end(), conjugate);
+                if (it == elements.end()) {
+                    throw std::invalid_argument("Lattice symmetry elements do not form a group");
+                }
+                classes[static_cast<std::size_t>(it - elements.begin())] = numClasses;
+            }
+            numClasses++;
+        }
+
+        return classes;
+    }
+}
+
+
+std::vector<SitePermutation> latticeAutomorphisms(Lattice const &lattice)
+{
+    std::vector<SitePermutation> automorphisms;
+    SitePermutation perm(lattice.numSites());
+    std::vector<bool> used(lattice.numSites(), false);
+    extendAutomorphism(perm, used, 0, adjacencyMatrix(lattice), automorphisms);
+    return automorphisms;
+}
+
+
+std::vector<SitePermutation> generateGroup(std::vector<SitePermutation> const &generators)
+{
+    auto const unit = identity(generators.empty() ? lattice().numSites() : generators[0].size());
+    std::vector<SitePermutation> elements{unit};
+    std::set<SitePermutation> known{unit};
+
+    // multiply every element by every generator until no new elements show up
+    for (std::size_t i = 0; i < elements.size(); ++i) {
+        for (auto const &generator : generators) {
+            auto const product = compose(generator, elements[i]);
+            if (known.insert(product).second) {
+                elements.push_back(product);
+            }
+        }
+    }
+
+    return elements;
+}
+
+
+std::pair<double, State> permute(SitePermutation const &perm, State const &state) noexcept
+{
+    State res;
+    // Images of the occupied bits in the order of creation operators in `state`.
+    std::array<std::size_t, State::bitsPerSite*maxNumSites> targets{};
+    std::size_t numTargets = 0;
+
+    for (std::size_t x = 0; x < perm.size(); ++x) {
+        if (state.hasParticleOn(x)) {
+            res.addParticleOn(perm[x]);
+            targets[numTargets++] = 2*perm[x];
+        }
+        if (state.hasHoleOn(x)) {
+            res.addHoleOn(perm[x]);
+            targets[numTargets++] = 2*perm[x] + 1;
+        }
+    }
+
+    // sign of the permutation that sorts the creation operators
+    std::size_t inversions = 0;
+    for (std::size_t i = 0; i < numTargets; ++i) {
+        for (std::size_t j = i + 1; j < numTargets; ++j) {
+            if (targets[i] > targets[j]) {
+                inversions++;
+            }
+        }
+    }
+
+    return {inversions % 2 == 0 ? +1.0 : -1.0, res};
+}
+
+
+LatticeSymmetry::LatticeSymmetry(std::vector<SitePermutation> elements)
+        : elements_{std::move(elements)}, weights_(elements_.size()), numClasses_{0}
+{
+    auto const classes = conjugacyClasses(elements_, numClasses_);
+
+    // Square roots of distinct primes are linearly independent over the rationals.
+    // So Z separates all irreps whose characters are rational and coincidences
+    // for other irreps would need an algebraic relation between the weights.
+    // The remaining primes give each element its own weight for Y.
+    // Weights are symmetrised under inversion so that W = Z + Y is symmetric.
+    auto const primes = firstPrimes(numClasses_ + elements_.size());
+    auto const classWeight = [&primes](std::size_t const cls) {
+        return std::sqrt(static_cast<double>(primes[cls]));
+    };
+    auto const elementWeight = [&primes, this](std::size_t const element) {
+        return std::sqrt(static_cast<double>(primes[numClasses_ + element]));
+    };
+    for (std::size_t i = 0; i < elements_.size(); ++i) {
+        auto const inv = static_cast<std::size_t>(
+                std::find(elements_.begin(), elements_.end(), inverse(elements_[i]))
+                - elements_.begin());
+        weights_[i] = classWeight(classes[i]) + classWeight(classes[inv])
+                      + elementWeight(i) + elementWeight(inv);
+    }
+}
+
+
+LatticeSymmetry LatticeSymmetry::fromLattice(Lattice const &lattice)
+{
+    if constexpr (not useLatticeSymmetry) {
+        return LatticeSymmetry{std::vector<SitePermutation>{identity(lattice.numSites())}};
+    }
+    else {
+        if (lattice.symmetryGenerators().empty()) {
+            return LatticeSymmetry{latticeAutomorphisms(lattice)};
+        }
+        return LatticeSymmetry{generateGroup(lattice.symmetryGenerators())};
+    }
+}
+
+
+std::size_t LatticeSymmetry::order() const noexcept
+{
+    return elements_.size();
+}
+
+
+std::size_t LatticeSymmetry::numClasses() const noexcept
+{
+    return numClasses_;
+}
+
+
+std::vector<SitePermutation> const &LatticeSymmetry::elements() const noexcept
+{
+    return elements_;
+}
+
+
+std::vector<DSparseMatrix> LatticeSymmetry::decompose(SumState const &basis,
+                                                      BasisIndex const &index) const
+{
+    /// Eigenvector of W on a single orbit.
+    struct OrbitVector
+    {
+        double eigenvalue;
+        std::vector<std::size_t> indices;
+        std::vector<double> coeffs;
+    };
+    std::vector<OrbitVector> vectors;
+    vectors.reserve(basis.size());
+
+    std::vector<bool> visited(basis.size(), false);
+    // position of basis states in the current orbit
+    std::vector<std::size_t> orbitPos(basis.size(), BasisIndex::npos);
+    std::vector<std::size_t> orbit;
+
+    auto const findPermuted = [&](SitePermutation const &perm, std::size_t const i) {
+        auto const [sign, state] = permute(perm, basis[i].second);
+        auto const j = index.find(state);
+        if (j == BasisIndex::npos) {
+            throw std::invalid_argument("Basis is not closed under lattice symmetries");
+        }
+        // account for the coefficients of the basis states
+        return std::pair{sign * basis[i].first * basis[j].first, j};
+    };
+
+    for (std::size_t rep = 0; rep < basis.size(); ++rep) {
+        if (visited[rep]) {
+            continue;
+        }
+
+        // all images of rep
+        orbit.clear();
+        for (auto const &element : elements_) {
+            auto const j = findPermuted(element, rep).second;
+            if (not visited[j]) {
+                visited[j] = true;
+                orbit.push_back(j);
+            }
+        }
+        std::sort(orbit.begin(), orbit.end());
+        for (std::size_t k = 0; k < orbit.size(); ++k) {
+            orbitPos[orbit[k]] = k;
+        }
+
+        // W restricted to the orbit
+        DMatrix z(orbit.size(), orbit.size(), 0.0);
+        for (std::size_t k = 0; k < orbit.size(); ++k) {
+            for (std::size_t e = 0; e < elements_.size(); ++e) {
+                auto const [sign, j] = findPermuted(elements_[e], orbit[k]);
+                z(orbitPos[j], k) += weights_[e] * sign;
+            }
+        }
+        DVector evals(orbit.size());
+        blaze::syev(z, evals, 'V', 'U');
+
+        // `syev` stores the eigenvectors row-wise in `z`.
+        for (std::size_t e = 0; e < evals.size(); ++e) {
+            OrbitVector vec{evals[e], {}, {}};
+            for (std::size_t k = 0; k < orbit.size(); ++k) {
+                if (double const coef = z(e, k); std::abs(coef) > 1e-13) {
+                    vec.indices.push_back(orbit[k]);
+                    vec.coeffs.push_back(coef);
+                }
+            }
+            vectors.push_back(std::move(vec));
+        }
+
+        for (auto const i : orbit) {
+            orbitPos[i] = BasisIndex::npos;
+        }
+    }
+
+    // Group vectors with equal eigenvalues, each group spans one invariant subspace.
+    std::stable_sort(vectors.begin(), vectors.end(),
+                     [](OrbitVector const &a, OrbitVector const &b) {
+                         return a.eigenvalue < b.eigenvalue;
+                     });
+    double scale = 0.0;
+    for (auto const w : weights_) {
+        scale += std::abs(w);
+    }
+    double const tolerance = 1e-8 * scale;
+
+    std::vector<DSparseMatrix> blocks;
+    for (auto first = vectors.begin(); first != vectors.end();) {
+        auto last = std::next(first);
+        while (last != vectors.end()
+               and last->eigenvalue - std::prev(last)->eigenvalue < tolerance) {
+            ++last;
+        }
+
+        std::vector<std::size_t> rowOffsets{0};
+        std::vector<std::size_t> columns;
+        std::vector<double> values;
+        for (auto it = first; it != last; ++it) {
+            columns.insert(columns.end(), it->indices.begin(), it->indices.end());
+            values.insert(values.end(), it->coeffs.begin(), it->coeffs.end());
+            rowOffsets.push_back(columns.size());
+        }
+        blocks.push_back(fromCompressedRows(rowOffsets.size() - 1, basis.size(),
+                                            rowOffsets, columns, values));
+
+        first = last;
+    }
+
+    return blocks;
+}
@@ -0,0 +1,112 @@
+#ifndef EXACT_HUBBARD_SYMMETRY_HPP
+#define EXACT_HUBBARD_SYMMETRY_HPP
+
+/** \file
+ * \brief Lattice symmetries and symmetry adapted bases.
+ */
+
+#include <utility>
+#include <vector>
+
+#include "basis_index.hpp"
+#include "config.hpp"
+#include "lattice.hpp"
+#include "linalg.hpp"
+#include "state.hpp"
+
+
+/// Find all permutations of sites that map the links of a lattice onto links with the same weight.
+std::vector<SitePermutation> latticeAutomorphisms(Lattice const &lattice);
+
+
+/// Construct all elements of the group generated by some site permutations.
+std::vector<SitePermutation> generateGroup(std::vector<SitePermutation> const &generators);
+
+
+/**
+ * Apply a site permutation to a state.
+ *
+ * Moves particles and holes from site `x` to `perm[x]`, i.e. maps
+ * \f$ a_x^\dagger \to a_{\mathrm{perm}[x]}^\dagger \f$ and
+ * \f$ b_x^\dagger \to b_{\mathrm{perm}[x]}^\dagger \f$.
+ * \return Sign from reordering the creation operators and the permuted state.
+ */
+std::pair<double, State> permute(SitePermutation const &perm, State const &state) noexcept;
+
+
+/**
+ * A group of lattice symmetries.
+ *
+ * Site permutations that leave the links of the lattice invariant commute with the Hamiltonian.
+ * So each sector can be split into invariant subspaces, one per row of each irreducible
+ * representation (irrep) of the group, and the Hamiltonian can be diagonalised
+ * in each of them separately.
+ * Eigenvalues of a d-dimensional irrep appear in d of the subspaces.
+ *
+ * The subspaces are found without character tables:
+ * The operator \f$ Z = \sum_g z_g P(g) \f$ is in the center of the group algebra if
+ * the weights \f$ z_g \f$ are constant on conjugacy classes.
+ * It acts as a scalar on each isotypic component and generic weights give
+ * different scalars for different (real) irreps.
+ * An isotypic component of a d-dimensional irrep holds d copies of the irrep
+ * and would be d times larger than needed.
+ * So \f$ W = Z + Y \f$ is diagonalised instead where \f$ Y = \sum_g y_g P(g) \f$
+ * has generic weights for every element.
+ * \f$ Y \f$ acts on each copy of an irrep in the same way and with distinct eigenvalues,
+ * so every eigenspace of \f$ W \f$ contains one row of each copy of an irrep.
+ * Irreps that are complex over the reals still give blocks of twice the minimal size.
+ * All \f$ P(g) \f$ commute with the Hamiltonian and so does \f$ W \f$.
+ * Since \f$ P(g) \f$ permutes states up to signs, \f$ W \f$ is block diagonal in
+ * orbits of basis states and it suffices to diagonalise it on each orbit separately.
+ */
+class LatticeSymmetry
+{
+public:
+    /// Construct from all elements of a group.
+    explicit LatticeSymmetry(std::vector<SitePermutation> elements);
+
+
+    /**
+     * Construct the symmetry group of a lattice.
+     *
+     * Uses the group generated by the symmetry generators of the lattice or all automorphisms
+     * of the lattice if no generators are given.
+     * The group is trivial if useLatticeSymmetry is false.
+     */
+    static LatticeSymmetry fromLattice(Lattice const &lattice);
+
+
+    /// Return the number of group elements.
+    [[nodiscard]] std::size_t order() const noexcept;
+
+
+    /// Return the number of conjugacy classes.
+    [[nodiscard]] std::size_t numClasses() const noexcept;
+
+
+    /// Return all group elements.
+    [[nodiscard]] std::vector<SitePermutation> const &elements() const noexcept;
+
+
+    /**
+     * Construct a symmetry adapted basis of a sector.
+     *
+     * \param basis Basis of a sector, must be closed under all group elements.
+     * \param index Index of `basis`.
+     * \return One matrix per invariant subspace.
+     *         The rows of each matrix are orthonormal vectors in `basis` which span the subspace.
+     */
+    [[nodiscard]] std::vector<DSparseMatrix> decompose(SumState const &basis,
+                                                       BasisIndex const &index) const;
+
+
+private:
+    /// All group elements.
+    std::vector<SitePermutation> elements_;
+    /// Weights of each element in W.
+    std::vector<double> weights_;
+    /// Number of conjugacy classes.
+    std::size_t numClasses_;
+};
+
+#endif //EXACT_HUBBARD_SYMMETRY_HPP